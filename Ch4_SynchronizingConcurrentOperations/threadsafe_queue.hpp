@@ -1,6 +1,9 @@
 #ifndef THREADSAFE_QUEUE_HPP_
 #define THREADSAFE_QUEUE_HPP_
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -68,11 +71,61 @@ public:
         return res;
     }
 
+    template<typename OutputIt>
+    std::size_t try_pop_bulk( OutputIt out, std::size_t max_n )
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        return pop_run(lk, out, max_n);
+    }
+
+    // Waits for at least one value, then takes up to max_n.
+    template<typename OutputIt>
+    std::size_t wait_and_pop_bulk( OutputIt out, std::size_t max_n )
+    {
+        if( max_n == 0 )
+            return 0;
+        std::unique_lock<std::mutex> lk(mtx);
+        data_cond.wait(lk, [this]{ return !data_queue.empty(); });
+        return pop_run(lk, out, max_n);
+    }
+
+    // Appends everything in the queue to values.
+    template<typename Container>
+    std::size_t drain( Container& values )
+    {
+        return try_pop_bulk(std::back_inserter(values), static_cast<std::size_t>(-1));
+    }
+
     bool empty() const
     {
         std::lock_guard<std::mutex> lk(mtx);
         return data_queue.empty();
     }
+
+private:
+    // A run that takes the whole queue swaps it out, and moves the values
+    // once the lock is released; a shorter one is moved out under the lock.
+    template<typename OutputIt>
+    std::size_t pop_run( std::unique_lock<std::mutex>& lk, OutputIt out, std::size_t max_n )
+    {
+        const std::size_t count = std::min(max_n, data_queue.size());
+        if( count == data_queue.size() ){
+            std::queue<T> run;
+            run.swap(data_queue);
+            lk.unlock();
+            for( ; !run.empty(); run.pop() ){
+                *out = std::move(run.front());
+                ++out;
+            }
+            return count;
+        }
+        for( std::size_t i=0; i<count; ++i ){
+            *out = std::move(data_queue.front());
+            ++out;
+            data_queue.pop();
+        }
+        return count;
+    }
 };
 
 
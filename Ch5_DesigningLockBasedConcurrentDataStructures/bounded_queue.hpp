@@ -0,0 +1,281 @@
+#ifndef BOUNDED_QUEUE_HPP_
+#define BOUNDED_QUEUE_HPP_
+
+/*
+** Bounded multi-producer multi-consumer queue after Dmitry Vyukov's
+** ring buffer. Capacity is rounded up to a power of two and all memory is
+** allocated up front, so pushing and popping never allocate (apart from the
+** shared_ptr overloads of pop, which keep threadsafe_queue's interface).
+** Each slot carries a sequence number telling whether it is free for the
+** push of a given round or holds that round's value. A push or pop claims
+** its slot with a single CAS on the enqueue or dequeue position.
+** try_push() fails when the queue is full. push() applies backpressure,
+** waiting until a consumer has made room, and wait_and_pop() waits on an
+** empty queue. By default they keep yielding, and the only shared writes
+** are the position CASes and slot sequences. With Blocking they yield for a
+** while and then sleep, which costs every successful push and pop, the
+** try_ ones included, a seq_cst fence to check for a sleeper on the other
+** side; the mutex and condition variables are only touched when somebody
+** is actually asleep.
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+
+template<typename T, bool Blocking = false>
+class bounded_queue
+{
+    // a push claims a slot before constructing into it, so must not throw
+    static_assert(std::is_nothrow_move_constructible<T>::value,
+                  "bounded_queue<T> requires a noexcept move constructor");
+
+    struct slot
+    {
+        std::atomic<std::size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* value() noexcept
+        {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    static constexpr unsigned yield_rounds = 64;
+
+    const std::size_t mask;
+    const std::unique_ptr<slot[]> slots;
+    alignas(64) std::atomic<std::size_t> enqueue_pos;
+    alignas(64) std::atomic<std::size_t> dequeue_pos;
+
+    // used only with Blocking
+    alignas(64) std::atomic<unsigned> sleeping_pushers;
+    std::atomic<unsigned> sleeping_poppers;
+    std::mutex sleep_mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+
+    static std::size_t round_up_capacity(std::size_t capacity) noexcept
+    {
+        std::size_t res = 2;
+        while(res < capacity){
+            res <<= 1;
+        }
+        return res;
+    }
+
+public:
+    explicit bounded_queue(std::size_t capacity)
+        : mask(round_up_capacity(capacity) - 1)
+        , slots(new slot[mask + 1])
+        , enqueue_pos(0), dequeue_pos(0)
+        , sleeping_pushers(0), sleeping_poppers(0)
+    {
+        for(std::size_t i=0; i<=mask; ++i){
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue& operator=(const bounded_queue&) = delete;
+
+    ~bounded_queue()
+    {
+        std::optional<T> discarded;
+        while(try_dequeue(discarded)){
+        }
+    }
+
+    // Leaves new_value untouched if the queue is full.
+    bool try_push(T&& new_value)
+    {
+        if(!try_enqueue(new_value)){
+            return false;
+        }
+        wake_one(sleeping_poppers, not_empty);
+        return true;
+    }
+
+    bool try_push(const T& new_value)
+    {
+        T copy(new_value);
+        return try_push(std::move(copy));
+    }
+
+    void push(T new_value)
+    {
+        for(unsigned i=0; !Blocking || i<yield_rounds; ++i){
+            if(try_enqueue(new_value)){
+                wake_one(sleeping_poppers, not_empty);
+                return;
+            }
+            std::this_thread::yield();
+        }
+        sleep_until(sleeping_pushers, not_full,
+                    [&]{ return try_enqueue(new_value); });
+        wake_one(sleeping_poppers, not_empty);
+    }
+
+    template<typename... Args>
+    void emplace(Args&&... args)
+    {
+        push(T(std::forward<Args>(args)...));
+    }
+
+    bool try_pop(T& value)
+    {
+        std::optional<T> res;
+        if(!try_dequeue(res)){
+            return false;
+        }
+        wake_one(sleeping_pushers, not_full);
+        value = std::move(*res);
+        return true;
+    }
+
+    std::shared_ptr<T> try_pop()
+    {
+        std::optional<T> res;
+        if(!try_dequeue(res)){
+            return nullptr;
+        }
+        wake_one(sleeping_pushers, not_full);
+        return std::make_shared<T>(std::move(*res));
+    }
+
+    void wait_and_pop(T& value)
+    {
+        value = std::move(wait_dequeue());
+    }
+
+    std::shared_ptr<T> wait_and_pop()
+    {
+        return std::make_shared<T>(wait_dequeue());
+    }
+
+    // both are only a snapshot when other threads are active
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    std::size_t size() const noexcept
+    {
+        const std::size_t tail = dequeue_pos.load(std::memory_order_relaxed);
+        const std::size_t head = enqueue_pos.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return mask + 1;
+    }
+
+private:
+    // Moves from value only if there was room.
+    bool try_enqueue(T& value) noexcept
+    {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for(;;){
+            slot& s = slots[pos & mask];
+            const std::size_t seq = s.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) -
+                              static_cast<std::intptr_t>(pos);
+            if(diff == 0){
+                if(enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                     std::memory_order_relaxed)){
+                    ::new (static_cast<void*>(s.storage)) T(std::move(value));
+                    s.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0){
+                return false;   // the slot still holds last round's value
+            }
+            else{
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_dequeue(std::optional<T>& res) noexcept
+    {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for(;;){
+            slot& s = slots[pos & mask];
+            const std::size_t seq = s.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) -
+                              static_cast<std::intptr_t>(pos + 1);
+            if(diff == 0){
+                if(dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                                     std::memory_order_relaxed)){
+                    res.emplace(std::move(*s.value()));
+                    s.value()->~T();
+                    s.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0){
+                return false;   // nothing pushed into the slot yet
+            }
+            else{
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    T wait_dequeue()
+    {
+        std::optional<T> res;
+        for(unsigned i=0; !Blocking || i<yield_rounds; ++i){
+            if(try_dequeue(res)){
+                wake_one(sleeping_pushers, not_full);
+                return std::move(*res);
+            }
+            std::this_thread::yield();
+        }
+        sleep_until(sleeping_poppers, not_empty,
+                    [&]{ return try_dequeue(res); });
+        wake_one(sleeping_pushers, not_full);
+        return std::move(*res);
+    }
+
+    // The fences pair with the one in wake_one(): either the sleeper's
+    // last attempt sees the other side's progress, or the other side sees
+    // the sleeper and notifies it under the mutex.
+    template<typename Predicate>
+    void sleep_until(std::atomic<unsigned>& sleepers,
+                     std::condition_variable& cond, Predicate done)
+    {
+        if constexpr(Blocking){
+            std::unique_lock<std::mutex> lk(sleep_mutex);
+            sleepers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            cond.wait(lk, done);
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void wake_one(std::atomic<unsigned>& sleepers, std::condition_variable& cond)
+    {
+        if constexpr(Blocking){
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(sleepers.load(std::memory_order_relaxed) != 0){
+                std::lock_guard<std::mutex> lk(sleep_mutex);
+                cond.notify_one();
+            }
+        }
+    }
+};
+
+
+#endif /* BOUNDED_QUEUE_HPP_ */
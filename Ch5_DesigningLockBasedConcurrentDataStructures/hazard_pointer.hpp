@@ -0,0 +1,224 @@
+#ifndef HAZARD_POINTER_HPP_
+#define HAZARD_POINTER_HPP_
+
+/*
+** Hazard pointers for the lock-free data structures. A thread publishes
+** the node it is about to dereference in a hazard_pointer; a node which has
+** been unlinked is handed to retire(), and deleted only once no hazard
+** pointer refers to it any more.
+** The hazard records live in one fixed table. Each thread keeps the
+** records it has claimed in a small cache for its lifetime, so creating a
+** hazard_pointer only touches the shared table the first few times.
+** Retired nodes collect in a per-thread list, which is scanned against
+** the table once it has grown to twice the table's size; that keeps the
+** cost of a scan amortized to a constant per node. Whatever is still
+** protected when a thread exits is passed on to the next thread to scan.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+namespace hazard_detail
+{
+
+constexpr std::size_t max_hazard_pointers = 128;
+constexpr std::size_t scan_threshold = 2 * max_hazard_pointers;
+
+struct hazard_record
+{
+    std::atomic<bool> claimed{false};
+    std::atomic<const void*> pointer{nullptr};
+};
+
+inline hazard_record records[max_hazard_pointers];
+
+struct retired_node
+{
+    void* node;
+    void (*deleter)(void*);
+};
+
+// Left behind by exited threads, adopted by the next scan.
+class orphanage
+{
+    std::mutex mtx;
+    std::vector<retired_node> nodes;
+    std::atomic<bool> any{false};
+
+public:
+    ~orphanage()
+    {
+        // no other thread is left to hold a hazard pointer
+        for(const retired_node& r : nodes){
+            r.deleter(r.node);
+        }
+    }
+
+    void give(std::vector<retired_node>& leftovers)
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        nodes.insert(nodes.end(), leftovers.begin(), leftovers.end());
+        any.store(true, std::memory_order_release);
+    }
+
+    void take(std::vector<retired_node>& into)
+    {
+        if(!any.load(std::memory_order_acquire)){
+            return;
+        }
+        std::lock_guard<std::mutex> lk(mtx);
+        into.insert(into.end(), nodes.begin(), nodes.end());
+        nodes.clear();
+        any.store(false, std::memory_order_relaxed);
+    }
+};
+
+inline orphanage& orphans()
+{
+    static orphanage instance;
+    return instance;
+}
+
+class thread_state
+{
+    std::vector<hazard_record*> free_records;
+    std::vector<retired_node> retired;
+
+public:
+    thread_state()
+    {
+        orphans();  // constructed first, so destroyed after every thread_state
+    }
+
+    ~thread_state()
+    {
+        scan();
+        if(!retired.empty()){
+            orphans().give(retired);
+        }
+        for(hazard_record* rec : free_records){
+            rec->claimed.store(false, std::memory_order_release);
+        }
+    }
+
+    hazard_record* acquire()
+    {
+        if(!free_records.empty()){
+            hazard_record* const rec = free_records.back();
+            free_records.pop_back();
+            return rec;
+        }
+        for(hazard_record& rec : records){
+            bool expected = false;
+            if(!rec.claimed.load(std::memory_order_relaxed) &&
+               rec.claimed.compare_exchange_strong(expected, true,
+                                                   std::memory_order_acquire)){
+                return &rec;
+            }
+        }
+        throw std::runtime_error("No hazard pointers available");
+    }
+
+    void release(hazard_record* rec)
+    {
+        rec->pointer.store(nullptr, std::memory_order_release);
+        free_records.push_back(rec);
+    }
+
+    void retire(retired_node r)
+    {
+        retired.push_back(r);
+        if(retired.size() >= scan_threshold){
+            scan();
+        }
+    }
+
+    void scan()
+    {
+        orphans().take(retired);
+        std::vector<const void*> hazards;
+        hazards.reserve(max_hazard_pointers);
+        for(const hazard_record& rec : records){
+            if(const void* p = rec.pointer.load(std::memory_order_seq_cst)){
+                hazards.push_back(p);
+            }
+        }
+        std::sort(hazards.begin(), hazards.end());
+        auto still_protected = std::partition(retired.begin(), retired.end(),
+            [&hazards](const retired_node& r){
+                return std::binary_search(hazards.begin(), hazards.end(),
+                                          static_cast<const void*>(r.node));
+            });
+        for(auto it = still_protected; it != retired.end(); ++it){
+            it->deleter(it->node);
+        }
+        retired.erase(still_protected, retired.end());
+    }
+};
+
+inline thread_state& this_thread_state()
+{
+    static thread_local thread_state state;
+    return state;
+}
+
+} // namespace hazard_detail
+
+
+class hazard_pointer
+{
+    hazard_detail::hazard_record* rec;
+
+public:
+    hazard_pointer()
+        : rec(hazard_detail::this_thread_state().acquire())
+        { }
+
+    hazard_pointer(const hazard_pointer&) = delete;
+    hazard_pointer& operator=(const hazard_pointer&) = delete;
+
+    ~hazard_pointer()
+    {
+        hazard_detail::this_thread_state().release(rec);
+    }
+
+    // Loads src and keeps the node it points to from being deleted until
+    // this hazard pointer is reset or protects something else.
+    template<typename T>
+    T* protect(const std::atomic<T*>& src) noexcept
+    {
+        T* p = src.load(std::memory_order_relaxed);
+        for(;;){
+            rec->pointer.store(p, std::memory_order_seq_cst);
+            T* const current = src.load(std::memory_order_seq_cst);
+            if(current == p){
+                return p;
+            }
+            p = current;
+        }
+    }
+
+    void reset() noexcept
+    {
+        rec->pointer.store(nullptr, std::memory_order_release);
+    }
+};
+
+
+// Deletes p once no hazard pointer refers to it. p must already be
+// unreachable for any thread which has not protected it yet.
+template<typename T>
+void retire(T* p)
+{
+    hazard_detail::this_thread_state().retire(
+        {p, [](void* node){ delete static_cast<T*>(node); }});
+}
+
+
+#endif /* HAZARD_POINTER_HPP_ */
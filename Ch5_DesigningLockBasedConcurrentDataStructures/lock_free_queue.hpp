@@ -0,0 +1,160 @@
+#ifndef LOCK_FREE_QUEUE_HPP_
+#define LOCK_FREE_QUEUE_HPP_
+
+/*
+** Unbounded lock-free multi-producer multi-consumer queue after Michael and
+** Scott. As in threadsafe_queue, head always points to a dummy node and the
+** values sit in the nodes after it. A push links its node in with a CAS on
+** the last node's next pointer and then swings tail; a pop swings head to
+** the next node and takes the value from there, making that node the new
+** dummy. Either may find tail lagging one node behind and moves it on
+** itself, so no thread ever waits for another.
+** Unlinked dummies are freed through hazard pointers, which also rules out
+** ABA on the head and tail CASes: a node cannot be reused while a thread
+** still holds it.
+** There is no wait_and_pop(); a consumer that needs to block belongs on
+** one of the lock-based queues.
+*/
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <utility>
+#include "hazard_pointer.hpp"
+
+
+template<typename T>
+class lock_free_queue
+{
+    struct node
+    {
+        std::optional<T> value;     // empty in the dummy
+        std::atomic<node*> next;
+
+        node() : next(nullptr) { }
+        template<typename... Args>
+        explicit node(std::in_place_t, Args&&... args)
+            : value(std::in_place, std::forward<Args>(args)...), next(nullptr)
+            { }
+    };
+
+    // head and tail are updated seq_cst throughout, as the hazard pointer
+    // scan relies on a single order of unlinking and protecting
+    alignas(64) std::atomic<node*> head;
+    alignas(64) std::atomic<node*> tail;
+
+public:
+    lock_free_queue()
+    {
+        node* const dummy = new node;
+        head.store(dummy, std::memory_order_relaxed);
+        tail.store(dummy, std::memory_order_relaxed);
+    }
+
+    lock_free_queue(const lock_free_queue&) = delete;
+    lock_free_queue& operator=(const lock_free_queue&) = delete;
+
+    ~lock_free_queue()
+    {
+        node* n = head.load(std::memory_order_relaxed);
+        while(n){
+            node* const next = n->next.load(std::memory_order_relaxed);
+            delete n;
+            n = next;
+        }
+    }
+
+    void push(T new_value)
+    {
+        link(new node(std::in_place, std::move(new_value)));
+    }
+
+    template<typename... Args>
+    void emplace(Args&&... args)
+    {
+        link(new node(std::in_place, std::forward<Args>(args)...));
+    }
+
+    bool try_pop(T& value)
+    {
+        hazard_pointer hp_head;
+        hazard_pointer hp_next;
+        node* const next = unlink_head(hp_head, hp_next);
+        if(!next){
+            return false;
+        }
+        value = std::move(*next->value);
+        next->value.reset();
+        return true;
+    }
+
+    std::shared_ptr<T> try_pop()
+    {
+        hazard_pointer hp_head;
+        hazard_pointer hp_next;
+        node* const next = unlink_head(hp_head, hp_next);
+        if(!next){
+            return nullptr;
+        }
+        auto res( std::make_shared<T>(std::move(*next->value)) );
+        next->value.reset();
+        return res;
+    }
+
+    // only a snapshot when other threads are active
+    bool empty() const
+    {
+        hazard_pointer hp;
+        return hp.protect(head)->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    void link(node* const n)
+    {
+        hazard_pointer hp;
+        for(;;){
+            node* last = hp.protect(tail);
+            node* next = last->next.load(std::memory_order_acquire);
+            if(next){
+                // help a push that has linked its node but not moved tail yet
+                tail.compare_exchange_weak(last, next);
+                continue;
+            }
+            if(last->next.compare_exchange_weak(next, n)){
+                tail.compare_exchange_strong(last, n);
+                return;
+            }
+        }
+    }
+
+    // Unlinks the dummy and retires it. Returns the node holding the value,
+    // which is the new dummy and stays protected by hp_next, so only the
+    // caller can touch its value; nullptr if the queue was empty. The caller
+    // destroys the value right away rather than when the node is freed.
+    node* unlink_head(hazard_pointer& hp_head, hazard_pointer& hp_next)
+    {
+        for(;;){
+            node* first = hp_head.protect(head);
+            node* const next = hp_next.protect(first->next);
+            // next is only safe once first is known to still be the dummy
+            if(head.load() != first){
+                continue;
+            }
+            if(!next){
+                return nullptr;
+            }
+            node* last = tail.load(std::memory_order_acquire);
+            if(first == last){
+                tail.compare_exchange_strong(last, next);
+            }
+            if(head.compare_exchange_strong(first, next)){
+                hp_head.reset();
+                retire(first);
+                return next;
+            }
+        }
+    }
+};
+
+
+#endif /* LOCK_FREE_QUEUE_HPP_ */
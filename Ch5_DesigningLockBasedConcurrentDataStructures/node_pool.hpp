@@ -0,0 +1,79 @@
+#ifndef NODE_POOL_HPP_
+#define NODE_POOL_HPP_
+
+/*
+** Recycles the nodes of one linked data structure, so that once it has
+** reached its peak size, it no longer allocates at all. Any thread may give
+** a node back: release() pushes it onto a lock-free stack. acquire() hands
+** nodes out of a private cache and refills that with the whole stack in a
+** single exchange, so the shared stack is touched once per batch rather
+** than once per node. acquire() is not thread-safe by itself; its callers
+** must already be serialized, as pushes are by the tail lock.
+** Nodes stay constructed while they are pooled; they are only destroyed
+** with the pool.
+*/
+
+#include <atomic>
+
+
+template<typename Node>
+class node_pool
+{
+    struct pooled : Node
+    {
+        pooled* next_free = nullptr;
+    };
+
+    std::atomic<pooled*> returned;
+    pooled* cache;
+
+    static void delete_all(pooled* n) noexcept
+    {
+        while(n){
+            pooled* const next = n->next_free;
+            delete n;
+            n = next;
+        }
+    }
+
+public:
+    node_pool()
+        : returned(nullptr), cache(nullptr)
+        { }
+
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+
+    ~node_pool()
+    {
+        delete_all(cache);
+        delete_all(returned.load(std::memory_order_acquire));
+    }
+
+    Node* acquire()
+    {
+        if(!cache){
+            cache = returned.exchange(nullptr, std::memory_order_acquire);
+            if(!cache){
+                return new pooled;
+            }
+        }
+        pooled* const n = cache;
+        cache = n->next_free;
+        return n;
+    }
+
+    // n must have come from this pool's acquire()
+    void release(Node* n) noexcept
+    {
+        pooled* const p = static_cast<pooled*>(n);
+        p->next_free = returned.load(std::memory_order_relaxed);
+        while(!returned.compare_exchange_weak(p->next_free, p,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)){
+        }
+    }
+};
+
+
+#endif /* NODE_POOL_HPP_ */
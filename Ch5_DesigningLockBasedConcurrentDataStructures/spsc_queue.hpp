@@ -0,0 +1,345 @@
+#ifndef SPSC_QUEUE_HPP_
+#define SPSC_QUEUE_HPP_
+
+/*
+** Bounded single-producer single-consumer ring buffer. Only one thread may
+** push and only one thread may pop; with that, every operation is a plain
+** load and store of the ring indices, without any CAS or lock.
+** The producer owns the tail and the consumer the head. Each sits on its
+** own cache line next to the owner's cached copy of the other index, so
+** the other side's line is only re-read when the ring looks full (to the
+** producer) or empty (to the consumer).
+** The bulk operations move a whole run of values with a single index
+** update.
+** push() blocks while the ring is full, and wait_and_pop() while it is
+** empty. By default they keep yielding, and nothing but the index stores
+** is shared. With Blocking they yield for a while and then sleep, which
+** costs every push and pop a seq_cst fence to check for a sleeper on the
+** other side; only ask for it where a side may wait for long.
+** The interface follows threadsafe_queue, except that push() applies
+** backpressure once the ring is full.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+
+template<typename T, bool Blocking = false>
+class spsc_queue
+{
+    struct slot
+    {
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* value() noexcept
+        {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    static constexpr unsigned yield_rounds = 64;
+
+    const std::size_t mask;
+    const std::unique_ptr<slot[]> slots;
+
+    // written by the producer only
+    alignas(64) std::atomic<std::size_t> tail;
+    std::size_t cached_head;
+
+    // written by the consumer only
+    alignas(64) std::atomic<std::size_t> head;
+    std::size_t cached_tail;
+
+    // used only with Blocking
+    alignas(64) std::atomic<bool> producer_sleeping;
+    std::atomic<bool> consumer_sleeping;
+    std::mutex sleep_mutex;
+    std::condition_variable cond;
+
+    static std::size_t round_up_capacity(std::size_t capacity) noexcept
+    {
+        std::size_t res = 2;
+        while(res < capacity){
+            res <<= 1;
+        }
+        return res;
+    }
+
+public:
+    explicit spsc_queue(std::size_t capacity = 1024)
+        : mask(round_up_capacity(capacity) - 1)
+        , slots(new slot[mask + 1])
+        , tail(0), cached_head(0)
+        , head(0), cached_tail(0)
+        , producer_sleeping(false), consumer_sleeping(false)
+        { }
+
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    ~spsc_queue()
+    {
+        const std::size_t end = tail.load(std::memory_order_relaxed);
+        for(std::size_t pos = head.load(std::memory_order_relaxed); pos != end; ++pos){
+            slots[pos & mask].value()->~T();
+        }
+    }
+
+    // Producer side.
+
+    bool try_push(T&& new_value)
+    {
+        return try_emplace(std::move(new_value));
+    }
+
+    bool try_push(const T& new_value)
+    {
+        return try_emplace(new_value);
+    }
+
+    template<typename... Args>
+    bool try_emplace(Args&&... args)
+    {
+        const std::size_t pos = tail.load(std::memory_order_relaxed);
+        if(free_slots(pos) == 0){
+            return false;
+        }
+        ::new (static_cast<void*>(slots[pos & mask].storage))
+            T(std::forward<Args>(args)...);
+        publish_tail(pos + 1);
+        return true;
+    }
+
+    void push(T new_value)
+    {
+        wait_for_room();
+        try_push(std::move(new_value));
+    }
+
+    template<typename... Args>
+    void emplace(Args&&... args)
+    {
+        wait_for_room();
+        try_emplace(std::forward<Args>(args)...);
+    }
+
+    // Moves as many values from [first,last) as there is room for, and
+    // returns the iterator past the last one moved.
+    template<typename InputIt>
+    InputIt try_push_bulk(InputIt first, InputIt last)
+    {
+        const std::size_t begin = tail.load(std::memory_order_relaxed);
+        std::size_t room = free_slots(begin, capacity());
+        std::size_t pos = begin;
+        try{
+            for(; room != 0 && first != last; --room, ++first, ++pos){
+                ::new (static_cast<void*>(slots[pos & mask].storage))
+                    T(std::move(*first));
+            }
+        }
+        catch(...){
+            if(pos != begin){
+                publish_tail(pos);
+            }
+            throw;
+        }
+        if(pos != begin){
+            publish_tail(pos);
+        }
+        return first;
+    }
+
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last)
+    {
+        while(first != last){
+            wait_for_room();
+            first = try_push_bulk(first, last);
+        }
+    }
+
+    // Consumer side.
+
+    bool try_pop(T& value)
+    {
+        const std::size_t pos = head.load(std::memory_order_relaxed);
+        if(ready_slots(pos) == 0){
+            return false;
+        }
+        T* const p = slots[pos & mask].value();
+        value = std::move(*p);
+        p->~T();
+        publish_head(pos + 1);
+        return true;
+    }
+
+    std::shared_ptr<T> try_pop()
+    {
+        const std::size_t pos = head.load(std::memory_order_relaxed);
+        if(ready_slots(pos) == 0){
+            return nullptr;
+        }
+        T* const p = slots[pos & mask].value();
+        auto res( std::make_shared<T>(std::move(*p)) );
+        p->~T();
+        publish_head(pos + 1);
+        return res;
+    }
+
+    void wait_and_pop(T& value)
+    {
+        wait_for_data();
+        try_pop(value);
+    }
+
+    std::shared_ptr<T> wait_and_pop()
+    {
+        wait_for_data();
+        return try_pop();
+    }
+
+    // Moves up to max_count values to out, returns how many it moved.
+    template<typename OutputIt>
+    std::size_t try_pop_bulk(OutputIt out, std::size_t max_count)
+    {
+        const std::size_t begin = head.load(std::memory_order_relaxed);
+        const std::size_t count = std::min(ready_slots(begin, max_count), max_count);
+        std::size_t pos = begin;
+        try{
+            for(; pos != begin + count; ++pos, ++out){
+                T* const p = slots[pos & mask].value();
+                *out = std::move(*p);
+                p->~T();
+            }
+        }
+        catch(...){
+            if(pos != begin){
+                publish_head(pos);
+            }
+            throw;
+        }
+        if(count != 0){
+            publish_head(pos);
+        }
+        return count;
+    }
+
+    // Waits for at least one value, then moves up to max_count.
+    template<typename OutputIt>
+    std::size_t wait_and_pop_bulk(OutputIt out, std::size_t max_count)
+    {
+        if(max_count == 0){
+            return 0;
+        }
+        wait_for_data();
+        return try_pop_bulk(out, max_count);
+    }
+
+    // both are only a snapshot when the other side is active
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    std::size_t size() const noexcept
+    {
+        // head first: read the other way round, the consumer could move it
+        // on past the tail just read
+        const std::size_t h = head.load(std::memory_order_acquire);
+        const std::size_t t = tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return mask + 1;
+    }
+
+private:
+    // Both only re-read the other side's index if the cached copy shows
+    // fewer than wanted slots.
+    std::size_t free_slots(std::size_t pos, std::size_t wanted = 1)
+    {
+        if(capacity() - (pos - cached_head) < wanted){
+            cached_head = head.load(std::memory_order_acquire);
+        }
+        return capacity() - (pos - cached_head);
+    }
+
+    std::size_t ready_slots(std::size_t pos, std::size_t wanted = 1)
+    {
+        if(cached_tail - pos < wanted){
+            cached_tail = tail.load(std::memory_order_acquire);
+        }
+        return cached_tail - pos;
+    }
+
+    void publish_tail(std::size_t pos)
+    {
+        tail.store(pos, std::memory_order_release);
+        wake(consumer_sleeping);
+    }
+
+    void publish_head(std::size_t pos)
+    {
+        head.store(pos, std::memory_order_release);
+        wake(producer_sleeping);
+    }
+
+    void wait_for_room()
+    {
+        wait_until(producer_sleeping, [this]{
+            return free_slots(tail.load(std::memory_order_relaxed)) != 0;
+        });
+    }
+
+    void wait_for_data()
+    {
+        wait_until(consumer_sleeping, [this]{
+            return ready_slots(head.load(std::memory_order_relaxed)) != 0;
+        });
+    }
+
+    // The fences pair with the one in wake(): either the sleeper's last
+    // check sees the other side's index, or the other side sees the
+    // sleeper and notifies it under the mutex.
+    template<typename Predicate>
+    void wait_until(std::atomic<bool>& sleeping, Predicate ready)
+    {
+        for(unsigned i=0; !Blocking || i<yield_rounds; ++i){
+            if(ready()){
+                return;
+            }
+            std::this_thread::yield();
+        }
+        if constexpr(Blocking){
+            std::unique_lock<std::mutex> lk(sleep_mutex);
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            cond.wait(lk, ready);
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void wake(std::atomic<bool>& sleeping)
+    {
+        if constexpr(Blocking){
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(sleeping.load(std::memory_order_relaxed)){
+                std::lock_guard<std::mutex> lk(sleep_mutex);
+                cond.notify_all();
+            }
+        }
+    }
+};
+
+
+#endif /* SPSC_QUEUE_HPP_ */
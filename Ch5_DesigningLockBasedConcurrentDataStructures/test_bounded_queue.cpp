@@ -0,0 +1,134 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bounded_queue.hpp"
+
+
+void test_capacity_is_a_power_of_two()
+{
+    assert(bounded_queue<int>(1).capacity() == 2);
+    assert(bounded_queue<int>(8).capacity() == 8);
+    assert(bounded_queue<int>(100).capacity() == 128);
+}
+
+void test_fifo_and_full()
+{
+    bounded_queue<std::string> q(4);
+    std::string value;
+    assert(q.empty() && !q.try_pop(value) && q.try_pop() == nullptr);
+    for(int i=0; i<4; ++i){
+        assert(q.try_push(std::to_string(i)));
+    }
+    std::string rejected("rejected");
+    assert(q.size() == 4 && !q.try_push(std::move(rejected)));
+    assert(rejected == "rejected");
+
+    // wrap around the ring a few times
+    for(int i=4; i<20; ++i){
+        assert(q.try_pop(value) && value == std::to_string(i-4));
+        assert(q.try_push(std::to_string(i)));
+    }
+    for(int i=16; i<20; ++i){
+        assert(*q.try_pop() == std::to_string(i));
+    }
+    assert(q.empty());
+}
+
+void test_remaining_values_are_destroyed()
+{
+    auto tracked = std::make_shared<int>(0);
+    {
+        bounded_queue<std::shared_ptr<int>> q(8);
+        for(int i=0; i<5; ++i){
+            q.push(tracked);
+        }
+        std::shared_ptr<int> value;
+        assert(q.try_pop(value));
+    }
+    assert(tracked.use_count() == 1);
+}
+
+template<bool Blocking>
+void test_push_blocks_until_there_is_room()
+{
+    bounded_queue<int, Blocking> q(2);
+    q.push(1);
+    q.push(2);
+    std::atomic<bool> pushed(false);
+    std::thread producer([&]{
+        q.push(3);
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(!pushed);
+    int value;
+    q.wait_and_pop(value);
+    assert(value == 1);
+    producer.join();
+    assert(pushed);
+    assert(*q.wait_and_pop() == 2);
+    q.wait_and_pop(value);
+    assert(value == 3 && q.empty());
+}
+
+template<bool Blocking>
+void test_many_producers_and_consumers()
+{
+    const int producer_count = 4;
+    const int consumer_count = 4;
+    const int per_producer = 100000;
+    bounded_queue<int, Blocking> q(64);
+    std::vector<std::thread> threads;
+    for(int p=0; p<producer_count; ++p){
+        threads.emplace_back([&q, p]{
+            for(int i=0; i<per_producer; ++i){
+                q.push(p*per_producer + i);
+            }
+        });
+    }
+    std::atomic<long long> sum(0);
+    std::atomic<bool> order_ok(true);
+    for(int c=0; c<consumer_count; ++c){
+        threads.emplace_back([&]{
+            // each consumer sees every producer's values in push order
+            std::vector<int> last_seen(producer_count, -1);
+            long long local = 0;
+            for(int i=0; i<producer_count*per_producer/consumer_count; ++i){
+                int value;
+                q.wait_and_pop(value);
+                const int p = value / per_producer;
+                if(value <= last_seen[p]){
+                    order_ok = false;
+                }
+                last_seen[p] = value;
+                local += value;
+            }
+            sum += local;
+        });
+    }
+    for(auto& t : threads){
+        t.join();
+    }
+    const long long n = producer_count * per_producer;
+    assert(order_ok);
+    assert(sum == n*(n-1)/2);
+    assert(q.empty());
+}
+
+
+int main()
+{
+    test_capacity_is_a_power_of_two();
+    test_fifo_and_full();
+    test_remaining_values_are_destroyed();
+    test_push_blocks_until_there_is_room<true>();
+    test_push_blocks_until_there_is_room<false>();
+    test_many_producers_and_consumers<true>();
+    test_many_producers_and_consumers<false>();
+    std::cout << "bounded_queue: all tests passed" << std::endl;
+}
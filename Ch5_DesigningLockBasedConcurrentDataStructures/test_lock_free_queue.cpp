@@ -0,0 +1,101 @@
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lock_free_queue.hpp"
+
+
+struct counted
+{
+    static std::atomic<int> alive;
+    int value;
+
+    explicit counted(int v = 0) : value(v) { ++alive; }
+    counted(const counted& other) : value(other.value) { ++alive; }
+    counted& operator=(const counted&) = default;
+    ~counted() { --alive; }
+};
+std::atomic<int> counted::alive(0);
+
+
+void test_fifo_order()
+{
+    lock_free_queue<std::string> q;
+    std::string value;
+    assert(q.empty() && !q.try_pop(value) && q.try_pop() == nullptr);
+    for(int i=0; i<10; ++i){
+        q.emplace(i+1, 'A');
+        q.push("Y tho?");
+    }
+    assert(!q.empty());
+    for(int i=0; i<10; ++i){
+        assert(q.try_pop(value) && value == std::string(i+1, 'A'));
+        assert(*q.try_pop() == "Y tho?");
+    }
+    assert(q.empty() && !q.try_pop(value));
+}
+
+void test_many_producers_and_consumers()
+{
+    const int producer_count = 4;
+    const int consumer_count = 4;
+    const int per_producer = 100000;
+    const int total = producer_count * per_producer;
+    {
+        lock_free_queue<counted> q;
+        std::vector<std::thread> threads;
+        for(int p=0; p<producer_count; ++p){
+            threads.emplace_back([&q, p]{
+                for(int i=0; i<per_producer; ++i){
+                    q.emplace(p*per_producer + i);
+                }
+            });
+        }
+        std::atomic<int> popped(0);
+        std::atomic<long long> sum(0);
+        std::atomic<bool> order_ok(true);
+        for(int c=0; c<consumer_count; ++c){
+            threads.emplace_back([&]{
+                // each consumer sees every producer's values in push order
+                std::vector<int> last_seen(producer_count, -1);
+                long long local = 0;
+                counted value;
+                while(popped < total){
+                    if(q.try_pop(value)){
+                        ++popped;
+                        const int p = value.value / per_producer;
+                        if(value.value <= last_seen[p]){
+                            order_ok = false;
+                        }
+                        last_seen[p] = value.value;
+                        local += value.value;
+                    }
+                    else{
+                        std::this_thread::yield();
+                    }
+                }
+                sum += local;
+            });
+        }
+        for(auto& t : threads){
+            t.join();
+        }
+        assert(order_ok);
+        assert(sum == static_cast<long long>(total)*(total-1)/2);
+        assert(q.empty());
+        q.emplace(-1);
+    }
+    // popped values are destroyed on the spot, the rest with the queue
+    assert(counted::alive == 0);
+}
+
+
+int main()
+{
+    test_fifo_order();
+    test_many_producers_and_consumers();
+    std::cout << "lock_free_queue: all tests passed" << std::endl;
+}
@@ -0,0 +1,112 @@
+#include <cassert>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spsc_queue.hpp"
+
+
+void test_fifo_wraps_around()
+{
+    spsc_queue<std::string> q(4);
+    assert(q.capacity() == 4 && q.empty());
+    std::string value;
+    assert(!q.try_pop(value) && q.try_pop() == nullptr);
+    for(int i=0; i<4; ++i){
+        assert(q.try_push(std::to_string(i)));
+    }
+    std::string rejected("rejected");
+    assert(!q.try_push(std::move(rejected)) && rejected == "rejected");
+    for(int i=4; i<20; ++i){
+        assert(q.try_pop(value) && value == std::to_string(i-4));
+        q.emplace(std::to_string(i));
+    }
+    assert(q.size() == 4);
+    for(int i=16; i<20; ++i){
+        assert(*q.try_pop() == std::to_string(i));
+    }
+    assert(q.empty());
+}
+
+void test_bulk_push_and_pop()
+{
+    spsc_queue<int> q(8);
+    std::vector<int> in{0,1,2,3,4,5,6,7,8,9};
+    auto rest = q.try_push_bulk(in.begin(), in.end());
+    assert(rest == in.begin() + 8 && q.size() == 8);
+
+    std::vector<int> out;
+    assert(q.try_pop_bulk(std::back_inserter(out), 5) == 5);
+    assert(q.try_push_bulk(rest, in.end()) == in.end());
+    assert(q.try_pop_bulk(std::back_inserter(out), 100) == 5);
+    assert(out == in && q.empty());
+    assert(q.try_pop_bulk(std::back_inserter(out), 100) == 0);
+}
+
+void test_remaining_values_are_destroyed()
+{
+    auto tracked = std::make_shared<int>(0);
+    {
+        spsc_queue<std::shared_ptr<int>> q(8);
+        for(int i=0; i<5; ++i){
+            q.push(tracked);
+        }
+        std::shared_ptr<int> value;
+        assert(q.try_pop(value));
+    }
+    assert(tracked.use_count() == 1);
+}
+
+template<bool Blocking>
+void test_pipeline()
+{
+    const int count = 1000000;
+    spsc_queue<int, Blocking> q(256);
+    std::thread producer([&q]{
+        std::vector<int> batch;
+        for(int i=0; i<count; ){
+            if(i % 3 == 0){
+                q.push(i++);
+                continue;
+            }
+            batch.clear();
+            for(int j=0; j<16 && i<count; ++j){
+                batch.push_back(i++);
+            }
+            q.push_bulk(batch.begin(), batch.end());
+        }
+    });
+    int expected = 0;
+    std::vector<int> batch;
+    while(expected < count){
+        if(expected % 2 == 0){
+            int value;
+            q.wait_and_pop(value);
+            assert(value == expected);
+            ++expected;
+        }
+        else{
+            batch.clear();
+            q.wait_and_pop_bulk(std::back_inserter(batch), 32);
+            for(int value : batch){
+                assert(value == expected);
+                ++expected;
+            }
+        }
+    }
+    producer.join();
+    assert(q.empty());
+}
+
+
+int main()
+{
+    test_fifo_wraps_around();
+    test_bulk_push_and_pop();
+    test_remaining_values_are_destroyed();
+    test_pipeline<true>();
+    test_pipeline<false>();
+    std::cout << "spsc_queue: all tests passed" << std::endl;
+}
@@ -1,8 +1,120 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <iterator>
+#include <new>
 #include <string>
+#include <thread>
+#include <vector>
 #include "threadsafe_queue.hpp"
 
 
+std::atomic<long> allocations(0);
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if(void* p = std::malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+void test_in_place_values()
+{
+    threadsafe_queue<std::string, queue_storage::in_place> q;
+    q.push("ONE");
+    q.emplace(3, 'X');
+    std::string s;
+    assert(q.try_pop(s) && s == "ONE");
+    assert(*q.wait_and_pop() == "XXX");
+    assert(q.empty() && !q.try_pop(s) && q.try_pop() == nullptr);
+}
+
+template<queue_storage Storage>
+void test_bulk_pop_and_drain()
+{
+    threadsafe_queue<std::string, Storage> q;
+    std::vector<std::string> out;
+    assert(q.try_pop_bulk(std::back_inserter(out), 8) == 0);
+    for(int i=0; i<10; ++i){
+        q.push(std::to_string(i));
+    }
+    assert(q.try_pop_bulk(std::back_inserter(out), 4) == 4);
+    assert(q.wait_and_pop_bulk(std::back_inserter(out), 3) == 3);
+    assert(q.drain(out) == 3);
+    assert(q.empty() && q.drain(out) == 0);
+    for(int i=0; i<10; ++i){
+        assert(out[i] == std::to_string(i));
+    }
+
+    // long enough to overflow the stack if the run were freed recursively
+    threadsafe_queue<int, Storage> numbers;
+    for(int i=0; i<1000000; ++i){
+        numbers.push(i);
+    }
+    std::vector<int> all;
+    assert(numbers.drain(all) == 1000000 && all.back() == 999999);
+    numbers.push(7);
+    int value;
+    assert(numbers.try_pop(value) && value == 7);
+
+    // and so would the nodes still queued when the queue goes
+    for(int i=0; i<1000000; ++i){
+        numbers.push(i);
+    }
+}
+
+void test_steady_state_does_not_allocate()
+{
+    threadsafe_queue<int, queue_storage::in_place> q;
+    const int count = 100000;
+    const int window = 64;
+    // warm the node pool up past the queue's peak size, leaving room for
+    // the nodes a consumer has popped but not given back yet
+    for(int i=0; i<2*window; ++i){
+        q.push(i);
+    }
+    int value;
+    for(int i=0; i<2*window; ++i){
+        q.wait_and_pop(value);
+    }
+
+    std::thread consumer([&q]{
+        int value;
+        for(int i=0; i<count; ++i){
+            q.wait_and_pop(value);
+            assert(value == i);
+        }
+    });
+    // the thread's start-up is done before this point
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const long before = allocations;
+    for(int i=0; i<count; ++i){
+        // stay within the warmed-up window
+        while(i >= window && !q.empty() && i % window == 0){
+            std::this_thread::yield();
+        }
+        q.push(i);
+    }
+    consumer.join();
+    assert(allocations == before);
+    assert(q.empty());
+}
+
 
 int main()
 {
@@ -16,4 +128,10 @@ int main()
     for(std::string s; tsq.try_pop(s); ){
         std::cout << s << std::endl;
     }
+
+    test_in_place_values();
+    test_steady_state_does_not_allocate();
+    test_bulk_pop_and_drain<queue_storage::shared>();
+    test_bulk_pop_and_drain<queue_storage::in_place>();
+    std::cout << "threadsafe_queue: all tests passed" << std::endl;
 }
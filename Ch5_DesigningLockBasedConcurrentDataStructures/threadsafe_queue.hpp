@@ -1,31 +1,59 @@
 #ifndef THREADSAFE_QUEUE_HPP_
 #define THREADSAFE_QUEUE_HPP_
 
+#include <cstddef>
+#include <iterator>
 #include <memory>
+#include <optional>
+#include <type_traits>
 #include <utility>
 #include <mutex>
 #include <condition_variable>
+#include "node_pool.hpp"
 
-template<typename T>
+/*
+** Nodes come from a per-queue node_pool and go back to it when popped.
+** With queue_storage::shared each value is held through a shared_ptr, so
+** the shared_ptr overloads of try_pop and wait_and_pop hand it out without
+** a copy, but every push allocates it. With queue_storage::in_place the
+** value sits in the node itself, and pushing and popping by reference no
+** longer allocate at all once the pool has warmed up.
+*/
+enum class queue_storage { shared, in_place };
+
+template<typename T, queue_storage Storage = queue_storage::shared>
 class threadsafe_queue
 {
 private:
+    struct node;
+    struct node_deleter
+    {
+        threadsafe_queue* queue;
+        void operator()(node* n) const noexcept { queue->recycle(n); }
+    };
+    using node_ptr = std::unique_ptr<node, node_deleter>;
+    using data_type = std::conditional_t<Storage == queue_storage::shared,
+                                         std::shared_ptr<T>, std::optional<T>>;
+
     struct node
     {
-        std::shared_ptr<T> data;
-        std::unique_ptr<node> next;
+        data_type data;
+        node_ptr next;
     };
 
+    // declared first, so that it outlives every node
+    node_pool<node> nodes;
     std::mutex head_mutex;
-    std::unique_ptr<node> head;
+    node_ptr head;
     std::mutex tail_mutex;
     node* tail;
     std::condition_variable data_cond;
 
 public:
     threadsafe_queue()
-        : head(new node), tail(head.get())
+        : head(nodes.acquire(), node_deleter{this}), tail(head.get())
         { }
+    ~threadsafe_queue();
     threadsafe_queue( const threadsafe_queue& ) = delete;
     threadsafe_queue& operator=( const threadsafe_queue& ) = delete;
 
@@ -36,41 +64,63 @@ public:
     void push(T new_value);
     template<typename... Args>
     void emplace( Args&&... args );
+    template<typename OutputIt>
+    std::size_t try_pop_bulk( OutputIt out, std::size_t max_n );
+    template<typename OutputIt>
+    std::size_t wait_and_pop_bulk( OutputIt out, std::size_t max_n );
+    template<typename Container>
+    std::size_t drain( Container& values );
     bool empty();
 
 private:
+    template<typename... Args>
+    static data_type make_data( Args&&... args );
+    static std::shared_ptr<T> share( data_type& data );
+    void link( data_type new_data );
+    void recycle( node* n ) noexcept;
     node* get_tail();
-    std::unique_ptr<node> pop_head();
+    node_ptr pop_head();
     std::unique_lock<std::mutex> wait_for_data();
-    std::unique_ptr<node> wait_pop_head();
-    std::unique_ptr<node> wait_pop_head(T& value);
-    std::unique_ptr<node> try_pop_head();
-    std::unique_ptr<node> try_pop_head(T& value);
+    node_ptr wait_pop_head();
+    node_ptr wait_pop_head(T& value);
+    node_ptr try_pop_head();
+    node_ptr try_pop_head(T& value);
+    node_ptr pop_run(std::size_t max_n);
+    template<typename OutputIt>
+    static std::size_t move_run(node_ptr run, OutputIt out);
 };
 
 
-template<typename T>
-void threadsafe_queue<T>::push(T new_value)
+template<typename T, queue_storage Storage>
+    template<typename... Args>
+typename threadsafe_queue<T,Storage>::data_type
+threadsafe_queue<T,Storage>::make_data( Args&&... args )
 {
-    auto new_data( std::make_shared<T>(std::move(new_value)) );
-    auto p( std::make_unique<node>() );
-    { std::lock_guard<std::mutex> tail_lock(tail_mutex);
-        tail->data = new_data;
-        node* const new_tail( p.get() );
-        tail->next = std::move(p);
-        tail = new_tail;
+    if constexpr(Storage == queue_storage::shared){
+        return std::make_shared<T>( std::forward<Args>(args)... );
+    }
+    else{
+        return data_type( std::in_place, std::forward<Args>(args)... );
     }
-    data_cond.notify_one();
 }
 
-template<typename T>
-    template<typename... Args>
-void threadsafe_queue<T>::emplace( Args&&... args )
+template<typename T, queue_storage Storage>
+std::shared_ptr<T> threadsafe_queue<T,Storage>::share( data_type& data )
+{
+    if constexpr(Storage == queue_storage::shared){
+        return data;
+    }
+    else{
+        return std::make_shared<T>( std::move(*data) );
+    }
+}
+
+template<typename T, queue_storage Storage>
+void threadsafe_queue<T,Storage>::link( data_type new_data )
 {
-    auto new_data( std::make_shared<T>( std::forward<Args>(args)... ) );
-    auto p( std::make_unique<node>() );
     { std::lock_guard<std::mutex> tail_lock(tail_mutex);
-        tail->data = new_data;
+        node_ptr p( nodes.acquire(), node_deleter{this} );
+        tail->data = std::move(new_data);
         node* const new_tail( p.get() );
         tail->next = std::move(p);
         tail = new_tail;
@@ -78,37 +128,69 @@ void threadsafe_queue<T>::emplace( Args&&... args )
     data_cond.notify_one();
 }
 
-template<typename T>
-typename threadsafe_queue<T>::node* threadsafe_queue<T>::get_tail()
+template<typename T, queue_storage Storage>
+void threadsafe_queue<T,Storage>::recycle( node* n ) noexcept
+{
+    n->data = data_type();
+    n->next.reset();
+    nodes.release(n);
+}
+
+// Unlinks the nodes one at a time, as destroying head would recycle the
+// chain recursively, once per node.
+template<typename T, queue_storage Storage>
+threadsafe_queue<T,Storage>::~threadsafe_queue()
+{
+    while(head){
+        auto next( std::move(head->next) );
+        head = std::move( next );
+    }
+}
+
+template<typename T, queue_storage Storage>
+void threadsafe_queue<T,Storage>::push(T new_value)
+{
+    link( make_data(std::move(new_value)) );
+}
+
+template<typename T, queue_storage Storage>
+    template<typename... Args>
+void threadsafe_queue<T,Storage>::emplace( Args&&... args )
+{
+    link( make_data(std::forward<Args>(args)...) );
+}
+
+template<typename T, queue_storage Storage>
+typename threadsafe_queue<T,Storage>::node* threadsafe_queue<T,Storage>::get_tail()
 {
     std::lock_guard<std::mutex> tail_lock(tail_mutex);
     return tail;
 }
-template<typename T>
-std::unique_ptr<typename threadsafe_queue<T>::node>
-threadsafe_queue<T>::pop_head()
+template<typename T, queue_storage Storage>
+typename threadsafe_queue<T,Storage>::node_ptr
+threadsafe_queue<T,Storage>::pop_head()
 {
     auto old_head( std::move(head) );
     head = std::move( old_head->next );
     return old_head;
 }
-template<typename T>
-std::unique_lock<std::mutex> threadsafe_queue<T>::wait_for_data()
+template<typename T, queue_storage Storage>
+std::unique_lock<std::mutex> threadsafe_queue<T,Storage>::wait_for_data()
 {
     std::unique_lock<std::mutex> head_lock(head_mutex);
     data_cond.wait( head_lock, [this]{ return head.get() != get_tail(); } );
-    return std::move(head_lock);
+    return head_lock;
 }
-template<typename T>
-std::unique_ptr<typename threadsafe_queue<T>::node>
-threadsafe_queue<T>::wait_pop_head()
+template<typename T, queue_storage Storage>
+typename threadsafe_queue<T,Storage>::node_ptr
+threadsafe_queue<T,Storage>::wait_pop_head()
 {
-    std::unique_ptr<std::mutex> head_lock(wait_for_data());
+    std::unique_lock<std::mutex> head_lock(wait_for_data());
     return pop_head();
 }
-template<typename T>
-std::unique_ptr<typename threadsafe_queue<T>::node>
-threadsafe_queue<T>::wait_pop_head(T& value)
+template<typename T, queue_storage Storage>
+typename threadsafe_queue<T,Storage>::node_ptr
+threadsafe_queue<T,Storage>::wait_pop_head(T& value)
 {
     std::unique_lock<std::mutex> head_lock(wait_for_data());
     value = std::move( *head->data );
@@ -116,22 +198,22 @@ threadsafe_queue<T>::wait_pop_head(T& value)
 }
 
 
-template<typename T>
-std::shared_ptr<T> threadsafe_queue<T>::wait_and_pop()
+template<typename T, queue_storage Storage>
+std::shared_ptr<T> threadsafe_queue<T,Storage>::wait_and_pop()
 {
     const auto old_head( wait_pop_head() );
-    return old_head->data;
+    return share(old_head->data);
 }
 
-template<typename T>
-void threadsafe_queue<T>::wait_and_pop(T& value)
+template<typename T, queue_storage Storage>
+void threadsafe_queue<T,Storage>::wait_and_pop(T& value)
 {
     const auto old_head( wait_pop_head(value) );
 }
 
-template<typename T>
-std::unique_ptr<typename threadsafe_queue<T>::node>
-threadsafe_queue<T>::try_pop_head()
+template<typename T, queue_storage Storage>
+typename threadsafe_queue<T,Storage>::node_ptr
+threadsafe_queue<T,Storage>::try_pop_head()
 {
     std::lock_guard<std::mutex> head_lock(head_mutex);
     if(head.get() == get_tail()){
@@ -140,9 +222,9 @@ threadsafe_queue<T>::try_pop_head()
     return pop_head();
 }
 
-template<typename T>
-std::unique_ptr<typename threadsafe_queue<T>::node>
-threadsafe_queue<T>::try_pop_head(T& value)
+template<typename T, queue_storage Storage>
+typename threadsafe_queue<T,Storage>::node_ptr
+threadsafe_queue<T,Storage>::try_pop_head(T& value)
 {
     std::lock_guard<std::mutex> head_lock(head_mutex);
     if(head.get() == get_tail()){
@@ -152,22 +234,98 @@ threadsafe_queue<T>::try_pop_head(T& value)
     return pop_head();
 }
 
-template<typename T>
-std::shared_ptr<T> threadsafe_queue<T>::try_pop()
+// Detaches up to max_n nodes from the front; the head lock must be held.
+// Only the pointers are walked here, the values are moved out by move_run()
+// once the lock has been released.
+template<typename T, queue_storage Storage>
+typename threadsafe_queue<T,Storage>::node_ptr
+threadsafe_queue<T,Storage>::pop_run(std::size_t max_n)
+{
+    node* const last( get_tail() );
+    node* prev( nullptr );
+    node* n( head.get() );
+    for(std::size_t count=0; count != max_n && n != last; ++count){
+        prev = n;
+        n = n->next.get();
+    }
+    if(!prev){
+        return nullptr;
+    }
+    auto run( std::move(head) );
+    head = std::move( prev->next );
+    return run;
+}
+
+// Recycles the run one node at a time, as recycling the chain in one go
+// would recurse once per node.
+template<typename T, queue_storage Storage>
+    template<typename OutputIt>
+std::size_t threadsafe_queue<T,Storage>::move_run(node_ptr run, OutputIt out)
+{
+    std::size_t count( 0 );
+    while(run){
+        *out = std::move( *run->data );
+        ++out;
+        ++count;
+        // not run = std::move(run->next): move assignment copies the
+        // deleter out of run->next only after the old node has been
+        // recycled, and another thread may already have taken it again
+        auto next( std::move(run->next) );
+        run = std::move( next );
+    }
+    return count;
+}
+
+template<typename T, queue_storage Storage>
+    template<typename OutputIt>
+std::size_t threadsafe_queue<T,Storage>::try_pop_bulk( OutputIt out, std::size_t max_n )
+{
+    node_ptr run;
+    { std::lock_guard<std::mutex> head_lock(head_mutex);
+        run = pop_run(max_n);
+    }
+    return move_run(std::move(run), out);
+}
+
+// Waits for at least one value, then takes up to max_n.
+template<typename T, queue_storage Storage>
+    template<typename OutputIt>
+std::size_t threadsafe_queue<T,Storage>::wait_and_pop_bulk( OutputIt out, std::size_t max_n )
+{
+    if(max_n == 0){
+        return 0;
+    }
+    node_ptr run;
+    { std::unique_lock<std::mutex> head_lock(wait_for_data());
+        run = pop_run(max_n);
+    }
+    return move_run(std::move(run), out);
+}
+
+// Appends everything in the queue to values.
+template<typename T, queue_storage Storage>
+    template<typename Container>
+std::size_t threadsafe_queue<T,Storage>::drain( Container& values )
+{
+    return try_pop_bulk( std::back_inserter(values), static_cast<std::size_t>(-1) );
+}
+
+template<typename T, queue_storage Storage>
+std::shared_ptr<T> threadsafe_queue<T,Storage>::try_pop()
 {
     auto old_head( try_pop_head() );
-    return old_head ? old_head->data : nullptr;
+    return old_head ? share(old_head->data) : nullptr;
 }
 
-template<typename T>
-bool threadsafe_queue<T>::try_pop(T& value)
+template<typename T, queue_storage Storage>
+bool threadsafe_queue<T,Storage>::try_pop(T& value)
 {
     const auto old_head( try_pop_head(value) );
     return old_head != nullptr;
 }
 
-template<typename T>
-bool threadsafe_queue<T>::empty()
+template<typename T, queue_storage Storage>
+bool threadsafe_queue<T,Storage>::empty()
 {
     std::lock_guard<std::mutex> head_lock( head_mutex );
     return ( head.get() == get_tail() );
@@ -175,4 +333,4 @@ bool threadsafe_queue<T>::empty()
 
 
 
-#endif 
+#endif
@@ -3,44 +3,82 @@
 
 /* 
 ** This is a thread-safe and exception-safe implementation of a concurrent,
-** recursive accumulate algorithm using std::async and std::future.
-** The exception safety is provided by the futures here. If an exception is
-** thrown by the recursive call the std::future created from the call
-** to std::async will be destroyed as the exception propagates. This will
-** in turn wait for the asynchronous task to finish thus avoiding a dangling
-** thread.
-** This implementation makes use of the standard library to handle the division
-** of work. The library ensures that std::async calls make use of the hardware
-** threads that are available without creating an unnecesserily large number
-** of threads. Some of the "asynchronous" calls will actually be executed
-** synchronously at the call to .get().
+** recursive accumulate algorithm on the work-stealing thread_pool.
+** Each level submits the first half of its range to the pool and recurses
+** into the second half itself. The exception safety is provided by waiting
+** on the first half's future before an exception from the second half
+** propagates, so no task is left reading the range once the call returns.
+** Submitted halves land on the submitting worker's own queue, where idle
+** workers steal them, and the pool's fixed set of workers bounds the number
+** of threads. A caller waiting on a future runs pending pool tasks
+** meanwhile, so many of the halves end up run by the thread which
+** submitted them, and this may also be called from inside a pool task.
+** Exceptions are not passed up the recursion but recorded in one
+** exception_collector. Once a half has thrown, the leaves not yet summed
+** are skipped, and every exception thrown is reported - a lone one as
+** itself, several of them together in an aggregate_exception.
 */
 
 
 #include <algorithm>
+#include <exception>
+#include <iterator>
 #include <numeric>
-#include <future>
+#include "work_stealing_thread_pool.hpp"
+#include "default_executor.hpp"
+#include "aggregate_exception.hpp"
 
 
 template<typename Iterator, typename T>
-T parallel_accumulate( Iterator first, Iterator last, T init )
+T parallel_accumulate_impl( thread_pool& pool, Iterator first, Iterator last,
+                            T init, exception_collector& errors )
 {
-    const unsigned length = std::distance(first, last);
-    const unsigned max_chunk_size = 25;
-    if(length <= max_chunk_size){
-        return std::accumulate(first, last, init);
+    try{
+        const unsigned length = std::distance(first, last);
+        const unsigned max_chunk_size = 25;
+        if(length <= max_chunk_size){
+            return errors.failed() ? init : std::accumulate(first, last, init);
+        }
+
+        Iterator mid_point = first;
+        std::advance( mid_point, length/2 );
+        pool_future<T> first_half_result =
+            pool.submit( [&pool, first, mid_point, init, &errors]{
+                return parallel_accumulate_impl(pool, first, mid_point, init,
+                                                errors); } );
+
+        // the first half uses errors, so it is waited for on every path
+        T second_half_result = T();
+        try{
+            second_half_result =
+                parallel_accumulate_impl(pool, mid_point, last, T(), errors);
+        }
+        catch(...){
+            first_half_result.wait();
+            throw;
+        }
+
+        return first_half_result.get() + second_half_result;
     }
-    
-    Iterator mid_point = first;
-    std::advance( mid_point, length/2 );
-    std::future<T> first_half_result =
-        std::async( parallel_accumulate<Iterator,T>
-                  , first, mid_point, init
-                  );
-    
-    T second_half_result = parallel_accumulate(mid_point, last, T());
-
-    return first_half_result.get() + second_half_result;
+    catch(...){
+        errors.record(std::current_exception());
+        return init;
+    }
+}
+
+template<typename Iterator, typename T>
+T parallel_accumulate( thread_pool& pool, Iterator first, Iterator last, T init )
+{
+    exception_collector errors;
+    T result = parallel_accumulate_impl(pool, first, last, init, errors);
+    errors.rethrow();
+    return result;
+}
+
+template<typename Iterator, typename T>
+T parallel_accumulate( Iterator first, Iterator last, T init )
+{
+    return parallel_accumulate(default_executor(), first, last, init);
 }
 
 
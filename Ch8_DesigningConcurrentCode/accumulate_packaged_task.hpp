@@ -3,90 +3,121 @@
 
 /* 
 ** This is a thread-safe and exception-safe implementation of a concurrent
-** accumulate algorithm using std::packaged_task, std::future and std::thread.
-** std::packaged_task in combination with the join_threads class provides
-** exception safety. All the exceptions are caught and propagated by
-** std::packaged_task, while the join_threads class assures that if any exceptions
-** are thrown all the threads are .join()'ed and closed correctly.
+** accumulate algorithm using the work-stealing thread_pool and its futures.
+** Each block but the last is submitted to the pool as a task, whose future
+** carries either the block's sum or the exception it threw, the way
+** std::packaged_task would; the calling thread sums the last block itself.
+** Every future is waited for on all exit paths, as the tasks refer to the
+** failure flag on the caller's stack - and while it waits the caller runs
+** pending pool tasks, so this may also be called from inside a pool task.
+** Once a block has thrown, the others stop at their next chunk, and every
+** exception thrown is reported - a lone one as itself, several of them
+** together in an aggregate_exception.
 */
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
 #include <numeric>
 #include <vector>
-#include <future>
-#include <thread>
+#include "work_stealing_thread_pool.hpp"
+#include "default_executor.hpp"
+#include "aggregate_exception.hpp"
 
 
-class join_threads
-{
-    std::vector<std::thread>& threads;
-public:
-    explicit join_threads(std::vector<std::thread>& threads_)
-        : threads( threads_ )
-        { }
-    ~join_threads()
-    {
-        for(auto it = threads.begin(); it != threads.end(); ++it){
-            if( it->joinable() )
-                it->join();
-        }
-    }
-};
-
+// The blocks run on pool, one per worker plus the caller's.
 template<typename Iterator, typename T>
-struct accumulate_block
-{
-    T operator()( Iterator first, Iterator last )
-    {
-        return std::accumulate(first, last, T());
-    }
-};
-
-template<typename Iterator, typename T>
-T parallel_accumulate(Iterator first, Iterator last, T init)
+T parallel_accumulate(thread_pool& pool, Iterator first, Iterator last, T init)
 {
     const unsigned long length = std::distance(first, last);
 
     if(!length)
         return init;
 
-    const unsigned long min_per_thread = 25;
-    const unsigned long max_threads = (length + min_per_thread - 1) / min_per_thread;
+    const unsigned long min_per_block = 25;
+    const unsigned long max_blocks = (length + min_per_block - 1) / min_per_block;
 
-    const unsigned long hardware_threads = std::thread::hardware_concurrency();
-    const unsigned long num_threads =
-        std::min( (hardware_threads!=0 ? hardware_threads : 2), max_threads );
+    const unsigned long pool_threads = pool.worker_count();
+    const unsigned long num_blocks = std::min( pool_threads + 1, max_blocks );
     
-    const unsigned long block_size = length / num_threads;
+    const unsigned long block_size = length / num_blocks;
 
-    std::vector<std::future<T>> futures;
-        futures.reserve(num_threads-1);
-    std::vector<std::thread> threads;
-        threads.reserve(num_threads-1);
-    // object similiar to scoped_thread - make sure all the threads are
-    // .join()'ed on scope exit - this provides exception safety
-    // ensuring that all threads are .joined and destoyed correctly
-    // on all scope exit paths
-    join_threads joiner(threads);
+    // the pool's tasks use it until their futures have all been waited for
+    std::atomic<bool> failed(false);
+    // the flag is only checked between chunks, which keeps the inner loop
+    // free of atomic loads
+    const unsigned long check_interval = 1024;
+    auto accumulate_until_failure =
+        [&failed, check_interval](Iterator block_first, Iterator block_last){
+            T res = T();
+            try{
+                unsigned long remaining = std::distance(block_first, block_last);
+                while(remaining && !failed.load(std::memory_order_relaxed)){
+                    const unsigned long chunk = std::min(remaining, check_interval);
+                    Iterator chunk_last = block_first;
+                    std::advance(chunk_last, chunk);
+                    res = std::accumulate(block_first, chunk_last, res);
+                    block_first = chunk_last;
+                    remaining -= chunk;
+                }
+            }
+            catch(...){
+                failed = true;
+                throw;
+            }
+            return res;
+        };
+
+    std::vector<pool_future<T>> futures;
+    futures.reserve(num_blocks-1);
 
     Iterator block_start = first;
-    for(unsigned long i=0; i<(num_threads-1); ++i){
-        Iterator block_end = block_start;
-        std::advance(block_end, block_size);
-        std::packaged_task<T(Iterator,Iterator)> task(accumulate_block<Iterator,T>());
-        futures.push_back( task.get_future() );
-        threads.push_back( std::thread(std::move(task), block_start, block_end) );
-        block_start = block_end;
+    try{
+        for(unsigned long i=0; i<(num_blocks-1); ++i){
+            Iterator block_end = block_start;
+            std::advance(block_end, block_size);
+            futures.push_back( pool.submit(
+                [&accumulate_until_failure, block_start, block_end]{
+                    return accumulate_until_failure(block_start, block_end); }) );
+            block_start = block_end;
+        }
+    }
+    catch(...){
+        failed = true;
+        for(auto& f : futures){
+            f.wait();
+        }
+        throw;
     }
 
-    T last_result = accumulate_block<Iterator,T>()(block_start, last);
+    std::vector<std::exception_ptr> errors;
     T result = init;
-    for(auto it = futures.cbegin(); it!=futures.cend(); ++it){
-        result += it->get();
+    T last_result = T();
+    try{
+        last_result = accumulate_until_failure(block_start, last);
+    }
+    catch(...){
+        errors.push_back(std::current_exception());
+    }
+    for(auto it = futures.begin(); it!=futures.end(); ++it){
+        try{
+            result += it->get();
+        }
+        catch(...){
+            errors.push_back(std::current_exception());
+        }
     }
+    rethrow_exceptions(std::move(errors));
     result += last_result;
     return result;
 }
 
+template<typename Iterator, typename T>
+T parallel_accumulate(Iterator first, Iterator last, T init)
+{
+    return parallel_accumulate(default_executor(), first, last, init);
+}
+
 
 #endif /* ACCUMULATE_PACKAGED_TASK_ */
@@ -2,49 +2,94 @@
 #define FIND_ASYNC_HPP_
 
 #include <algorithm>
-#include <future>
+#include <iterator>
+#include "work_stealing_thread_pool.hpp"
+#include "default_executor.hpp"
+#include "cancellation.hpp"
 
 
 template<typename Iterator, typename MatchType>
-Iterator parallel_find_impl(Iterator first, Iterator last, MatchType match,
-                            std::atomic<bool>& done)
+Iterator parallel_find_impl(thread_pool& pool,
+                            Iterator first, Iterator last, MatchType match,
+                            cancellation_source& found,
+                            const cancellation_token& token)
 {
     try{
         const unsigned long length = std::distance(first, last);
         const unsigned long min_per_thread = 25;
         if( length<(2*min_per_thread) ){
-            for(; (first!=last) && !done.load(); ++first){
+            for(; (first!=last) && !found.is_cancelled() &&
+                  !token.is_cancelled(); ++first){
                 if( *first == match ){
-                    done.store(true);
+                    found.cancel();
                     return first;
                 }
             }
             return last;
         }
         else{
-            const Iterator mid_point = first;
-            std::advance( const_cast<Iterator>(mid_point), length/2 );
-            std::future<Iterator> async_result =
-                std::async(&parallel_find_impl<Iterator, MatchType>,
-                           mid_point, last, match, std::ref(done));
-            const Iterator direct_result =
-                parallel_find_impl(first, mid_point, match, done);
-            return (direct_result == mid_point) ?
-                async_result.get() : direct_result;
+            Iterator mid_point = first;
+            std::advance( mid_point, length/2 );
+            // found and token live on the caller's stack, so the submitted
+            // half is waited for on every path
+            pool_future<Iterator> async_result =
+                pool.submit([&pool, mid_point, last, match, &found, &token]{
+                    return parallel_find_impl(pool, mid_point, last, match,
+                                              found, token);
+                });
+            Iterator direct_result = mid_point;
+            try{
+                direct_result = parallel_find_impl(pool, first, mid_point,
+                                                   match, found, token);
+            }
+            catch(...){
+                found.cancel();
+                async_result.wait();
+                throw;
+            }
+            if(direct_result == mid_point){
+                return async_result.get();
+            }
+            async_result.wait();
+            return direct_result;
         }
     }
     catch(...){
-        done.store(true);
+        found.cancel();
         throw;
     }
 }
 
+// As the packaged_task version: the halves run on pool, a match cancels
+// the rest of the search, and so does cancelling token, which makes it
+// return last.
 template<typename Iterator, typename MatchType>
-Iterator parallel_find( Iterator first, Iterator last, MatchType match )
+Iterator parallel_find( thread_pool& pool, Iterator first, Iterator last,
+                        MatchType match, const cancellation_token& token )
+{
+    cancellation_source found;
+    return parallel_find_impl(pool, first, last, match, found, token);
+}
+
+template<typename Iterator, typename MatchType>
+Iterator parallel_find( Iterator first, Iterator last, MatchType match,
+                        const cancellation_token& token )
 {
-    std::atomic<bool> done(false);
-    return parallel_find_impl(first, last, match, done);
+    return parallel_find(default_executor(), first, last, match, token);
 }
 
+template<typename Iterator, typename MatchType>
+Iterator parallel_find( thread_pool& pool, Iterator first, Iterator last,
+                        MatchType match )
+{
+    return parallel_find(pool, first, last, match, cancellation_token());
+}
+
+template<typename Iterator, typename MatchType>
+Iterator parallel_find( Iterator first, Iterator last, MatchType match )
+{
+    return parallel_find(default_executor(), first, last, match,
+                         cancellation_token());
+}
 
 #endif /* FIND_ASYNC_HPP_ */
@@ -2,27 +2,36 @@
 #define FIND_PACKAGED_TASK_HPP_
 
 #include <algorithm>
+#include <iterator>
 #include <vector>
-#include <thread>
 #include <future>
-#include "join_threads.hpp"
+#include "work_stealing_thread_pool.hpp"
+#include "default_executor.hpp"
+#include "cancellation.hpp"
 
 
+// The blocks run on pool, one per worker plus the caller's. The first block
+// to find a match cancels the search for the others. A caller may also give
+// up on the search through token, in which case it stops early and returns
+// last unless a match has already been found.
 template<typename Iterator, typename MatchType>
-Iterator parallel_find(Iterator first, Iterator last, MatchType match)
+Iterator parallel_find(thread_pool& pool, Iterator first, Iterator last,
+                       MatchType match, const cancellation_token& token)
 {
     struct find_element
     {
         void operator()(Iterator begin, Iterator end,
                         MatchType match,
                         std::promise<Iterator>* result,
-                        std::atomic<bool>* done_flag)
+                        cancellation_source* found,
+                        const cancellation_token* token)
         {
             try{
-                for(; (begin!=end) && !done_flag->load(); ++begin){
+                for(; (begin!=end) && !found->is_cancelled() &&
+                      !token->is_cancelled(); ++begin){
                     if(*begin == match){
                         result->set_value(begin);
-                        done_flag->store(true);
+                        found->cancel();
                         return;
                     }
                 }
@@ -30,7 +39,7 @@ Iterator parallel_find(Iterator first, Iterator last, MatchType match)
             catch(...){
                 try{
                     result->set_exception(std::current_exception());
-                    done_flag->store(true);
+                    found->cancel();
                 }
                 catch(...) { }
             }
@@ -41,36 +50,68 @@ Iterator parallel_find(Iterator first, Iterator last, MatchType match)
     if(!length)
         return last;
 
-    const unsigned long min_per_thread = 25;
-    const unsigned long max_threads = (length + min_per_thread - 1)/min_per_thread;
-    const unsigned long hardware_threads = std::thread::hardware_concurrency();
-    const unsigned long num_threads =
-        std::min((hardware_threads != 0 ? hardware_threads : 2), max_threads);
-    const unsigned long block_size = length / num_threads;
+    const unsigned long min_per_block = 25;
+    const unsigned long max_blocks = (length + min_per_block - 1)/min_per_block;
+    const unsigned long pool_threads = pool.worker_count();
+    const unsigned long num_blocks = std::min(pool_threads + 1, max_blocks);
+    const unsigned long block_size = length / num_blocks;
 
     std::promise<Iterator> result;
-    std::atomic<bool> done_flag(false);
-    std::vector<std::thread> threads;
-    threads.reserve(num_threads-1);
-    {
-        join_threads joiner(threads);
-        
+    cancellation_source found;
+    // the blocks refer to result and found, so every one of them is waited
+    // for - the caller runs pending pool tasks meanwhile
+    std::vector<pool_future<void>> blocks;
+    blocks.reserve(num_blocks-1);
+    try{
         Iterator block_start = first;
-        for(unsigned long i=0; i<(num_threads-1); ++i){
+        for(unsigned long i=0; i<(num_blocks-1); ++i){
             Iterator block_end = block_start;
             std::advance(block_end, block_size);
-            threads.push_back( std::thread(find_element(),
-                                           block_start, block_end, match,
-                                           &result, &done_flag) );
+            blocks.push_back( pool.submit(
+                [block_start, block_end, match, &result, &found, &token]{
+                    find_element()(block_start, block_end, match,
+                                   &result, &found, &token);
+                }) );
             block_start = block_end;
         }
-        find_element()(block_start, last, match, &result, &done_flag);
+        find_element()(block_start, last, match, &result, &found, &token);
+    }
+    catch(...){
+        found.cancel();
+        for(auto& block : blocks){
+            block.wait();
+        }
+        throw;
+    }
+    for(auto& block : blocks){
+        block.wait();
     }
-    if(!done_flag.load()){
+    if(!found.is_cancelled()){
         return last;
     }
     return result.get_future().get();
 }
 
+template<typename Iterator, typename MatchType>
+Iterator parallel_find(Iterator first, Iterator last, MatchType match,
+                       const cancellation_token& token)
+{
+    return parallel_find(default_executor(), first, last, match, token);
+}
+
+template<typename Iterator, typename MatchType>
+Iterator parallel_find(thread_pool& pool, Iterator first, Iterator last,
+                       MatchType match)
+{
+    return parallel_find(pool, first, last, match, cancellation_token());
+}
+
+template<typename Iterator, typename MatchType>
+Iterator parallel_find(Iterator first, Iterator last, MatchType match)
+{
+    return parallel_find(default_executor(), first, last, match,
+                         cancellation_token());
+}
+
 
 #endif /* FIND_PACKAGED_TASK_HPP_ */
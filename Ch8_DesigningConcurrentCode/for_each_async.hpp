@@ -2,32 +2,73 @@
 #define FOR_EACH_ASYNC_HPP_
 
 #include <algorithm>
-#include <future>
+#include <exception>
+#include <iterator>
+#include "work_stealing_thread_pool.hpp"
+#include "default_executor.hpp"
+#include "aggregate_exception.hpp"
 
 
+// Recursively submits the first half of the range to pool and processes the
+// second half on the calling thread, which runs pending pool tasks while it
+// waits for the other half. Exceptions are not passed up the recursion but
+// recorded in errors, which also stops the other halves at their next
+// element.
 template<typename Iterator, typename Function>
-void parallel_for_each(Iterator first, Iterator last, Function func)
+void parallel_for_each_impl(thread_pool& pool, Iterator first, Iterator last,
+                            Function& func, exception_collector& errors)
 {
-    const unsigned long length = std::distance(first, last);
-    if(!length)
-        return;
+    try{
+        const unsigned long length = std::distance(first, last);
+        const unsigned long min_per_thread = 25;
 
-    const unsigned long min_per_thread = 25;
+        if(length < (2*min_per_thread)){
+            for(; first != last && !errors.failed(); ++first){
+                func(*first);
+            }
+        }
+        else{
+            Iterator mid_point = first;
+            std::advance( mid_point, length/2 );
 
-    if(length < (2*min_per_thread)){
-        std::for_each(first, last, func);
+            pool_future<void> first_half =
+                pool.submit([&pool, first, mid_point, func,
+                             &errors]() mutable {
+                    parallel_for_each_impl(pool, first, mid_point, func,
+                                           errors);
+                });
+            // the first half uses errors, so it is waited for on every path
+            try{
+                parallel_for_each_impl(pool, mid_point, last, func, errors);
+            }
+            catch(...){
+                first_half.wait();
+                throw;
+            }
+            first_half.wait();
+        }
     }
-    else{
-        Iterator mid_point = first;
-        std::advance( mid_point, length/2 );
-        
-        std::future<void> first_half =
-            std::async(&parallel_for_each<Iterator,Function>,
-                first, mid_point, func);
-        parallel_for_each(mid_point, last, func);
-        first_half.get();
+    catch(...){
+        errors.record(std::current_exception());
     }
 }
 
+// Every exception thrown is reported - a lone one as itself, several of
+// them together in an aggregate_exception.
+template<typename Iterator, typename Function>
+void parallel_for_each(thread_pool& pool, Iterator first, Iterator last,
+                       Function func)
+{
+    exception_collector errors;
+    parallel_for_each_impl(pool, first, last, func, errors);
+    errors.rethrow();
+}
+
+template<typename Iterator, typename Function>
+void parallel_for_each(Iterator first, Iterator last, Function func)
+{
+    parallel_for_each(default_executor(), first, last, func);
+}
+
 
 #endif /* FOR_EACH_ASYNC_HPP_ */
@@ -2,51 +2,99 @@
 #define FOR_EACH_PACKAGED_TASK_HPP_
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
 #include <vector>
-#include <future>
-#include <thread>
-#include "join_threads.hpp"
+#include "work_stealing_thread_pool.hpp"
+#include "default_executor.hpp"
+#include "aggregate_exception.hpp"
 
 
+// The blocks run on pool, one per worker plus the caller's, which runs
+// pending pool tasks while it waits for the others' futures.
+// Once func has thrown for one element, the other blocks stop at their next
+// element. Every exception thrown is reported - a lone one as itself,
+// several of them together in an aggregate_exception.
 template<typename Iterator, typename Function>
-void parallel_for_each(Iterator first, Iterator last, Function func)
+void parallel_for_each(thread_pool& pool, Iterator first, Iterator last,
+                       Function func)
 {
     const unsigned long length = std::distance(first, last);
     if(!length)
         return;
 
-    const unsigned long min_per_thread = 25;
-    const unsigned long max_threads =
-        (length + min_per_thread - 1)/min_per_thread;
+    const unsigned long min_per_block = 25;
+    const unsigned long max_blocks =
+        (length + min_per_block - 1)/min_per_block;
 
-    const unsigned long hardware_threads = std::thread::hardware_concurrency();
-    const unsigned long num_threads =
-        std::min((hardware_threads != 0 ? hardware_threads : 2), max_threads);
+    const unsigned long pool_threads = pool.worker_count();
+    const unsigned long num_blocks = std::min(pool_threads + 1, max_blocks);
     
-    const unsigned long block_size = length/num_threads;
+    const unsigned long block_size = length/num_blocks;
+
+    // the pool's tasks use it until their futures have all been waited for
+    std::atomic<bool> failed(false);
+    // each block gets its own copy of func, as with std::for_each
+    auto for_each_until_failure =
+        [&failed](Iterator block_first, Iterator block_last, Function& func){
+            try{
+                for(; block_first != block_last &&
+                      !failed.load(std::memory_order_relaxed); ++block_first){
+                    func(*block_first);
+                }
+            }
+            catch(...){
+                failed = true;
+                throw;
+            }
+        };
 
-    std::vector<std::future<void>> futures;
-    futures.reserve(num_threads-1);
-    std::vector<std::thread> threads;
-    threads.reserve(num_threads-1);
-    join_threads joiner(threads);
+    std::vector<pool_future<void>> futures;
+    futures.reserve(num_blocks-1);
 
     Iterator block_start = first;
-    for(unsigned long i=0; i<(num_threads-1); ++i){
-        Iterator block_end = block_start;
-        std::advance(block_end, block_size);
-        std::packaged_task<void(void)> task(
-            [block_start, block_end, func](){
-                std::for_each(block_start, block_end, func);
-            });
-        futures.push_back( task.get_future() );
-        threads.push_back( std::thread(std::move(task)) );
-        block_start = block_end;
+    try{
+        for(unsigned long i=0; i<(num_blocks-1); ++i){
+            Iterator block_end = block_start;
+            std::advance(block_end, block_size);
+            futures.push_back( pool.submit(
+                [block_start, block_end, func,
+                 &for_each_until_failure]() mutable {
+                    for_each_until_failure(block_start, block_end, func);
+                }) );
+            block_start = block_end;
+        }
+    }
+    catch(...){
+        failed = true;
+        for(auto& f : futures){
+            f.wait();
+        }
+        throw;
+    }
+    std::vector<std::exception_ptr> errors;
+    try{
+        for_each_until_failure(block_start, last, func);
+    }
+    catch(...){
+        errors.push_back(std::current_exception());
     }
-    std::for_each(block_start, last, func);
-    for(unsigned long i=0; i<(num_threads-1); ++i){
-        futures[i].get();   // strictly for the purpose of propagating exceptions
+    for(unsigned long i=0; i<(num_blocks-1); ++i){
+        try{
+            futures[i].get();   // strictly for the purpose of propagating exceptions
+        }
+        catch(...){
+            errors.push_back(std::current_exception());
+        }
     }
+    rethrow_exceptions(std::move(errors));
+}
+
+template<typename Iterator, typename Function>
+void parallel_for_each(Iterator first, Iterator last, Function func)
+{
+    parallel_for_each(default_executor(), first, last, func);
 }
 
 
@@ -37,4 +37,11 @@ TEST_CASE( "parallel_find_packaged_task", "[find][packaged_task]" )
         REQUIRE( parallel_find(test_list.cbegin(), test_list.cend(), 11) ==
             test_list.cend() );
     }
+
+    SECTION( "A cancelled search finds nothing" ){
+        cancellation_source source;
+        source.cancel();
+        REQUIRE( parallel_find(test_list.cbegin(), test_list.cend(), 42,
+                               source.token()) == test_list.cend() );
+    }
 }
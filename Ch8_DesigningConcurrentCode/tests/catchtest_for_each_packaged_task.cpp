@@ -4,6 +4,10 @@
 #include <numeric>
 #include <random>
 #include <chrono>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <thread>
 #include "for_each_packaged_task.hpp"
 
 
@@ -78,3 +82,33 @@ TEST_CASE( "parallel_for_each_packaged_task", "[for_each][packaged_task]" )
         REQUIRE( test_list2 == expected2 );
     }
 }
+
+TEST_CASE( "parallel_for_each_packaged_task reports every exception",
+           "[for_each][packaged_task][exceptions]" )
+{
+    std::list<int> test_list(1000, 1);
+    std::atomic<unsigned> calls(0);
+    auto failing_action = [&calls](int&){
+        ++calls;
+        throw std::runtime_error("failing action");
+    };
+
+    std::size_t reported = 0;
+    try{
+        parallel_for_each(test_list.begin(), test_list.end(), failing_action);
+    }
+    catch(const aggregate_exception& e){
+        for(const auto& error : e.exceptions()){
+            REQUIRE_THROWS_AS( std::rethrow_exception(error), std::runtime_error );
+        }
+        reported = e.size();
+    }
+    catch(const std::runtime_error&){
+        reported = 1;
+    }
+    // every block stops at its first element, or before it once another
+    // block has failed
+    REQUIRE( reported >= 1 );
+    REQUIRE( reported == calls );
+    REQUIRE( calls <= default_executor().worker_count() + 1 );
+}
@@ -0,0 +1,115 @@
+#ifndef AGGREGATE_EXCEPTION_HPP_
+#define AGGREGATE_EXCEPTION_HPP_
+
+/*
+** Carries every exception thrown by the tasks of one parallel operation,
+** rather than only the first one somebody happened to call get() on.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+class aggregate_exception : public std::exception
+{
+    std::vector<std::exception_ptr> errors;
+    std::string message;
+
+    static std::string describe(const std::vector<std::exception_ptr>& errors)
+    {
+        std::string res = std::to_string(errors.size()) + " tasks failed";
+        if(!errors.empty()){
+            try{
+                std::rethrow_exception(errors.front());
+            }
+            catch(const std::exception& e){
+                res += ", the first with: ";
+                res += e.what();
+            }
+            catch(...){
+            }
+        }
+        return res;
+    }
+
+public:
+    explicit aggregate_exception(std::vector<std::exception_ptr> errors_)
+        : errors(std::move(errors_)), message(describe(errors))
+        { }
+
+    const char* what() const noexcept override
+    {
+        return message.c_str();
+    }
+
+    const std::vector<std::exception_ptr>& exceptions() const noexcept
+    {
+        return errors;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return errors.size();
+    }
+};
+
+
+// Does nothing if errors is empty, and rethrows a lone exception unchanged,
+// so a caller expecting a single failure still catches it by its own type.
+inline void rethrow_exceptions(std::vector<std::exception_ptr> errors)
+{
+    if(errors.size() == 1){
+        std::rethrow_exception(errors.front());
+    }
+    if(errors.size() > 1){
+        throw aggregate_exception(std::move(errors));
+    }
+}
+
+
+// Gathers the exceptions of one parallel operation as its tasks throw them,
+// for algorithms whose tasks record their failure here rather than pass it
+// up through a future. Tasks which are still running can check failed()
+// to stop early once one of them has thrown.
+class exception_collector
+{
+    std::atomic<bool> failure_seen;
+    std::mutex errors_mutex;
+    std::vector<std::exception_ptr> errors;
+
+public:
+    exception_collector()
+        : failure_seen(false)
+        { }
+
+    exception_collector(const exception_collector&) = delete;
+    exception_collector& operator=(const exception_collector&) = delete;
+
+    void record(std::exception_ptr error)
+    {
+        {
+            std::lock_guard<std::mutex> lk(errors_mutex);
+            errors.push_back(std::move(error));
+        }
+        failure_seen.store(true, std::memory_order_release);
+    }
+
+    bool failed() const noexcept
+    {
+        return failure_seen.load(std::memory_order_relaxed);
+    }
+
+    // once every task has finished; see rethrow_exceptions()
+    void rethrow()
+    {
+        rethrow_exceptions(std::move(errors));
+    }
+};
+
+
+#endif /* AGGREGATE_EXCEPTION_HPP_ */
@@ -0,0 +1,8 @@
+#include "waitable_thread_pool.hpp"
+#include "pool_benchmark.hpp"
+
+
+int main(int argc, char* argv[])
+{
+    return run_pool_benchmarks<thread_pool>("waitable_thread_pool", argc, argv);
+}
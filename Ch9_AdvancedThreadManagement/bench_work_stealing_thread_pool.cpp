@@ -0,0 +1,8 @@
+#include "work_stealing_thread_pool.hpp"
+#include "pool_benchmark.hpp"
+
+
+int main(int argc, char* argv[])
+{
+    return run_pool_benchmarks<thread_pool>("work_stealing_thread_pool", argc, argv);
+}
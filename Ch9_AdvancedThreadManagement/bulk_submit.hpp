@@ -0,0 +1,79 @@
+#ifndef BULK_SUBMIT_HPP_
+#define BULK_SUBMIT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+// result type of the callables in a range passed to submit_bulk()
+template<typename InputIt>
+using bulk_result_t =
+    std::invoke_result_t<typename std::iterator_traits<InputIt>::value_type>;
+
+
+// Shared state of the n tasks created by thread_pool::submit_n(). Each task
+// runs func(index); the last one to finish makes the completion future
+// ready, carrying the first exception thrown by any of them.
+template<typename Function>
+class batch_completion
+{
+    Function func;
+    std::atomic<std::size_t> remaining;
+    std::atomic<bool> failed;
+    std::exception_ptr first_error;
+    std::promise<void> done;
+
+public:
+    batch_completion(Function func_, std::size_t count)
+        : func(std::move(func_)), remaining(count), failed(false)
+        { }
+
+    std::future<void> get_future() { return done.get_future(); }
+
+    void run(std::size_t index) noexcept
+    {
+        try{
+            func(index);
+        }
+        catch(...){
+            if(!failed.exchange(true)){
+                first_error = std::current_exception();
+            }
+        }
+        // acq_rel makes first_error visible to whichever task finishes last
+        if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            if(first_error)
+                done.set_exception(first_error);
+            else
+                done.set_value();
+        }
+    }
+};
+
+// Creates the shared state and hands out one task per index to add_task.
+template<typename Function, typename AddTask>
+std::future<void> make_batch_tasks(std::size_t count, Function f,
+                                   AddTask add_task)
+{
+    if(!count){
+        std::promise<void> nothing_to_do;
+        nothing_to_do.set_value();
+        return nothing_to_do.get_future();
+    }
+    auto batch( std::make_shared<batch_completion<Function>>(
+                    std::move(f), count) );
+    std::future<void> res( batch->get_future() );
+    for(std::size_t i=0; i<count; ++i){
+        add_task([batch, i]{ batch->run(i); });
+    }
+    return res;
+}
+
+
+#endif /* BULK_SUBMIT_HPP_ */
@@ -0,0 +1,101 @@
+#ifndef CANCELLATION_HPP_
+#define CANCELLATION_HPP_
+
+/*
+** Cooperative cancellation. A cancellation_source hands out tokens which
+** share its flag; cancel() sets the flag once and for all. Tasks wrapped with
+** make_cancellable() check their token just before they would start, so
+** whatever is still queued when the source is cancelled is skipped without
+** running, and a running task can poll is_cancelled() - a single load - to
+** give up early. A default-constructed token can never be cancelled.
+*/
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+// stored in the future of a task which was cancelled before it ran
+struct task_cancelled : std::exception
+{
+    const char* what() const noexcept override
+    {
+        return "task cancelled";
+    }
+};
+
+
+class cancellation_token
+{
+    std::shared_ptr<const std::atomic<bool>> cancelled;
+
+    friend class cancellation_source;
+    explicit cancellation_token(std::shared_ptr<const std::atomic<bool>> flag)
+        : cancelled(std::move(flag))
+        { }
+
+public:
+    cancellation_token() = default;
+
+    bool can_be_cancelled() const noexcept
+    {
+        return cancelled != nullptr;
+    }
+
+    bool is_cancelled() const noexcept
+    {
+        return cancelled && cancelled->load(std::memory_order_acquire);
+    }
+
+    void throw_if_cancelled() const
+    {
+        if(is_cancelled()){
+            throw task_cancelled();
+        }
+    }
+};
+
+
+class cancellation_source
+{
+    std::shared_ptr<std::atomic<bool>> cancelled;
+
+public:
+    cancellation_source()
+        : cancelled(std::make_shared<std::atomic<bool>>(false))
+        { }
+
+    cancellation_token token() const
+    {
+        return cancellation_token(cancelled);
+    }
+
+    void cancel() noexcept
+    {
+        cancelled->store(true, std::memory_order_release);
+    }
+
+    bool is_cancelled() const noexcept
+    {
+        return cancelled->load(std::memory_order_acquire);
+    }
+};
+
+
+// Wraps f so that it throws task_cancelled instead of running if token has
+// been cancelled by the time it is picked up.
+template<typename Function>
+auto make_cancellable(cancellation_token token, Function f)
+{
+    return [token=std::move(token), f=std::move(f)]() mutable
+               -> std::invoke_result_t<Function&>
+    {
+        token.throw_if_cancelled();
+        return f();
+    };
+}
+
+
+#endif /* CANCELLATION_HPP_ */
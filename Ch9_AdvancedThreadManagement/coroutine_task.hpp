@@ -0,0 +1,474 @@
+#ifndef COROUTINE_TASK_HPP_
+#define COROUTINE_TASK_HPP_
+
+/*
+** C++20 coroutines on top of the work-stealing thread_pool.
+** task<T> is lazy: the coroutine does not start until it is awaited, and
+** when it finishes it resumes its awaiter directly (symmetric transfer), on
+** whichever thread it finished on. A task which starts with
+** co_await pool.schedule() therefore runs on the pool, and so does the code
+** which awaited it from then on - nothing blocks a worker while waiting.
+** when_all() starts a set of tasks and resumes its awaiter once all of them
+** have finished; tasks which schedule themselves on the pool run in
+** parallel. sync_wait() is the bridge from ordinary code: it blocks the
+** calling thread, which should not be a pool worker, until a task is done.
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "work_stealing_thread_pool.hpp"
+
+
+template<typename T = void>
+class task;
+
+
+class task_promise_base
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<Promise> finished) noexcept
+        {
+            const std::coroutine_handle<> next =
+                finished.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+protected:
+    void rethrow_if_failed()
+    {
+        if(error){
+            std::rethrow_exception(error);
+        }
+    }
+
+public:
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() noexcept
+    {
+        error = std::current_exception();
+    }
+
+    void set_continuation(std::coroutine_handle<> awaiting) noexcept
+    {
+        continuation = awaiting;
+    }
+};
+
+template<typename T>
+class task_promise : public task_promise_base
+{
+    std::optional<T> value;
+
+public:
+    task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& result)
+    {
+        value.emplace(std::forward<U>(result));
+    }
+
+    T result()
+    {
+        rethrow_if_failed();
+        return std::move(*value);
+    }
+};
+
+template<>
+class task_promise<void> : public task_promise_base
+{
+public:
+    task<void> get_return_object() noexcept;
+
+    void return_void() noexcept { }
+
+    void result()
+    {
+        rethrow_if_failed();
+    }
+};
+
+
+template<typename T>
+class task
+{
+public:
+    using promise_type = task_promise<T>;
+    using value_type = T;
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    // awaiting a task starts it, and it resumes the awaiter when done
+    struct awaiter_base
+    {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept
+        {
+            return !handle || handle.done();
+        }
+
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            handle.promise().set_continuation(awaiting);
+            return handle;
+        }
+    };
+
+public:
+    explicit task(std::coroutine_handle<promise_type> handle_) noexcept
+        : handle(handle_)
+        { }
+
+    task(task&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr))
+        { }
+
+    task& operator=(task&& other) noexcept
+    {
+        if(this != &other){
+            if(handle){
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task()
+    {
+        if(handle){
+            handle.destroy();
+        }
+    }
+
+    bool is_ready() const noexcept
+    {
+        return !handle || handle.done();
+    }
+
+    // co_await yields the result, or rethrows the task's exception
+    auto operator co_await() const noexcept
+    {
+        struct awaiter : awaiter_base
+        {
+            T await_resume()
+            {
+                return this->handle.promise().result();
+            }
+        };
+        return awaiter{{handle}};
+    }
+
+    // Only for a finished task: its result, or its exception rethrown. The
+    // result is moved out, so take it once.
+    T result() const
+    {
+        return handle.promise().result();
+    }
+
+    // Completes along with the task but yields nothing and never throws;
+    // the result is then taken with a second co_await, which does not
+    // suspend.
+    auto when_ready() const noexcept
+    {
+        struct awaiter : awaiter_base
+        {
+            void await_resume() const noexcept { }
+        };
+        return awaiter{{handle}};
+    }
+};
+
+template<typename T>
+task<T> task_promise<T>::get_return_object() noexcept
+{
+    return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+    return task<void>(
+        std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+
+// Counts down the tasks of a when_all() plus the awaiter itself; whoever
+// gets to zero resumes the awaiter.
+class when_all_latch
+{
+    std::atomic<std::size_t> count;
+    std::coroutine_handle<> awaiting;
+
+public:
+    explicit when_all_latch(std::size_t task_count) noexcept
+        : count(task_count+1)
+        { }
+
+    // false if every task had already finished, so there is no need to wait
+    bool try_await(std::coroutine_handle<> awaiting_) noexcept
+    {
+        awaiting = awaiting_;
+        return count.fetch_sub(1, std::memory_order_acq_rel) > 1;
+    }
+
+    std::coroutine_handle<> arrive() noexcept
+    {
+        if(count.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            return awaiting;
+        }
+        return std::noop_coroutine();
+    }
+};
+
+// Runs one task of a when_all() and reports to the latch once it has
+// suspended for the last time, so that the awaiter may destroy it.
+class when_all_child
+{
+public:
+    struct promise_type
+    {
+        when_all_latch* latch = nullptr;
+
+        struct final_awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<promise_type> finished) noexcept
+            {
+                return finished.promise().latch->arrive();
+            }
+
+            void await_resume() const noexcept { }
+        };
+
+        when_all_child get_return_object() noexcept
+        {
+            return when_all_child(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        final_awaiter final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept { }
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit when_all_child(std::coroutine_handle<promise_type> handle_) noexcept
+        : handle(handle_)
+        { }
+
+public:
+    when_all_child(when_all_child&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr))
+        { }
+
+    when_all_child(const when_all_child&) = delete;
+    when_all_child& operator=(const when_all_child&) = delete;
+
+    ~when_all_child()
+    {
+        if(handle){
+            handle.destroy();
+        }
+    }
+
+    void start(when_all_latch& latch) noexcept
+    {
+        handle.promise().latch = &latch;
+        handle.resume();
+    }
+};
+
+template<typename T>
+when_all_child make_when_all_child(const task<T>& t)
+{
+    co_await t.when_ready();
+}
+
+// Starts the given tasks one after the other - each runs until it first
+// suspends - and resumes the awaiter when the last one has finished.
+class when_all_ready_awaiter
+{
+    when_all_latch latch;
+    std::vector<when_all_child> children;
+
+public:
+    explicit when_all_ready_awaiter(std::vector<when_all_child> children_)
+        : latch(children_.size()), children(std::move(children_))
+        { }
+
+    bool await_ready() const noexcept { return children.empty(); }
+
+    bool await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        for(auto& child : children){
+            child.start(latch);
+        }
+        return latch.try_await(awaiting);
+    }
+
+    void await_resume() const noexcept { }
+};
+
+
+template<typename T>
+task<std::vector<T>> when_all(std::vector<task<T>> tasks)
+{
+    std::vector<when_all_child> children;
+    children.reserve(tasks.size());
+    for(const auto& t : tasks){
+        children.push_back(make_when_all_child(t));
+    }
+    co_await when_all_ready_awaiter(std::move(children));
+    std::vector<T> res;
+    res.reserve(tasks.size());
+    for(const auto& t : tasks){
+        res.push_back(co_await t);
+    }
+    co_return res;
+}
+
+// all the tasks are awaited; the first exception among them is rethrown
+inline task<void> when_all(std::vector<task<void>> tasks)
+{
+    std::vector<when_all_child> children;
+    children.reserve(tasks.size());
+    for(const auto& t : tasks){
+        children.push_back(make_when_all_child(t));
+    }
+    co_await when_all_ready_awaiter(std::move(children));
+    for(const auto& t : tasks){
+        co_await t;
+    }
+}
+
+template<typename... Ts>
+task<std::tuple<Ts...>> when_all(task<Ts>... tasks)
+{
+    static_assert((!std::is_void<Ts>::value && ...),
+                  "use the vector overload of when_all for task<void>");
+    std::vector<when_all_child> children;
+    children.reserve(sizeof...(Ts));
+    (children.push_back(make_when_all_child(tasks)), ...);
+    co_await when_all_ready_awaiter(std::move(children));
+    // the braces make sure the results are taken in order
+    co_return std::tuple<Ts...>{ co_await tasks... };
+}
+
+
+// Signals sync_wait() once the awaited task has finished.
+class sync_wait_task
+{
+public:
+    struct promise_type
+    {
+        std::mutex* m = nullptr;
+        std::condition_variable* cond = nullptr;
+        bool* done = nullptr;
+
+        struct final_awaiter
+        {
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<promise_type> finished) noexcept
+            {
+                promise_type& p = finished.promise();
+                std::lock_guard<std::mutex> lk(*p.m);
+                *p.done = true;
+                p.cond->notify_all();
+            }
+
+            void await_resume() const noexcept { }
+        };
+
+        sync_wait_task get_return_object() noexcept
+        {
+            return sync_wait_task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        final_awaiter final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept { }
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit sync_wait_task(std::coroutine_handle<promise_type> handle_) noexcept
+        : handle(handle_)
+        { }
+
+public:
+    sync_wait_task(const sync_wait_task&) = delete;
+    sync_wait_task& operator=(const sync_wait_task&) = delete;
+
+    ~sync_wait_task()
+    {
+        handle.destroy();
+    }
+
+    void run()
+    {
+        std::mutex m;
+        std::condition_variable cond;
+        bool done = false;
+        promise_type& p = handle.promise();
+        p.m = &m;
+        p.cond = &cond;
+        p.done = &done;
+        handle.resume();
+        std::unique_lock<std::mutex> lk(m);
+        cond.wait(lk, [&done]{ return done; });
+    }
+};
+
+template<typename T>
+sync_wait_task make_sync_wait_task(const task<T>& t)
+{
+    co_await t.when_ready();
+}
+
+template<typename T>
+T sync_wait(task<T> t)
+{
+    make_sync_wait_task(t).run();
+    return t.result();
+}
+
+
+#endif /* COROUTINE_TASK_HPP_ */
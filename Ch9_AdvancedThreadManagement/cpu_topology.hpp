@@ -0,0 +1,158 @@
+#ifndef CPU_TOPOLOGY_HPP_
+#define CPU_TOPOLOGY_HPP_
+
+/*
+** Which CPUs the process may run on and which NUMA node each of them belongs
+** to, read from /sys/devices/system/node on Linux. Elsewhere (or if sysfs is
+** not available) every CPU is reported as part of node 0 and pinning is a
+** no-op.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <filesystem>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+struct placement_policy
+{
+    bool pin_workers = false;          // pin worker i to one CPU, node by node
+    bool numa_aware_stealing = true;   // pinned workers steal within their
+                                       // node before crossing to other nodes
+};
+
+
+// parses the sysfs cpulist format, e.g. "0-3,8,10-11"
+inline std::vector<unsigned> parse_cpu_list(const std::string& list)
+{
+    std::vector<unsigned> res;
+    std::size_t pos = 0;
+    while(pos < list.size()){
+        std::size_t end = list.find(',', pos);
+        if(end == std::string::npos){
+            end = list.size();
+        }
+        const std::string range = list.substr(pos, end-pos);
+        const std::size_t dash = range.find('-');
+        try{
+            const unsigned first = std::stoul(range.substr(0, dash));
+            const unsigned last = (dash == std::string::npos) ?
+                first : std::stoul(range.substr(dash+1));
+            for(unsigned cpu=first; cpu<=last; ++cpu){
+                res.push_back(cpu);
+            }
+        }
+        catch(...) { }  // blank or malformed entry
+        pos = end+1;
+    }
+    return res;
+}
+
+
+class cpu_topology
+{
+    // usable CPUs ordered by NUMA node, so that consecutive workers share a
+    // node; nodes[i] is the node of cpus[i]
+    std::vector<unsigned> cpus;
+    std::vector<unsigned> nodes;
+    unsigned node_count_;
+
+public:
+    cpu_topology()
+        : node_count_(1)
+    {
+        std::vector<std::pair<unsigned,unsigned>> node_cpu;  // (node, cpu)
+        std::vector<unsigned> allowed;
+#if defined(__linux__)
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if(sched_getaffinity(0, sizeof(mask), &mask) == 0){
+            for(unsigned cpu=0; cpu<CPU_SETSIZE; ++cpu){
+                if(CPU_ISSET(cpu, &mask))
+                    allowed.push_back(cpu);
+            }
+        }
+        std::error_code ec;
+        for(std::filesystem::directory_iterator it("/sys/devices/system/node", ec), end;
+            !ec && it != end; it.increment(ec))
+        {
+            const std::string name = it->path().filename().string();
+            if(name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+               name.find_first_not_of("0123456789", 4) != std::string::npos){
+                continue;
+            }
+            const unsigned node = std::stoul(name.substr(4));
+            std::ifstream cpulist(it->path() / "cpulist");
+            std::string list;
+            std::getline(cpulist, list);
+            for(unsigned cpu : parse_cpu_list(list)){
+                if(std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                    node_cpu.emplace_back(node, cpu);
+            }
+        }
+#endif
+        if(node_cpu.empty()){
+            if(allowed.empty()){
+                for(unsigned cpu=0; cpu<std::thread::hardware_concurrency(); ++cpu)
+                    allowed.push_back(cpu);
+            }
+            for(unsigned cpu : allowed){
+                node_cpu.emplace_back(0, cpu);
+            }
+        }
+        std::sort(node_cpu.begin(), node_cpu.end());
+
+        // renumber the nodes densely, sysfs ids can have gaps
+        node_count_ = 0;
+        for(std::size_t i=0; i<node_cpu.size(); ++i){
+            if(i == 0 || node_cpu[i].first != node_cpu[i-1].first){
+                ++node_count_;
+            }
+            nodes.push_back(node_count_-1);
+            cpus.push_back(node_cpu[i].second);
+        }
+        if(!node_count_){
+            node_count_ = 1;
+        }
+    }
+
+    std::size_t cpu_count() const noexcept { return cpus.size(); }
+    unsigned node_count() const noexcept { return node_count_; }
+
+    // workers are laid out node by node, wrapping round if there are more
+    // workers than CPUs
+    unsigned cpu_for_worker(unsigned worker) const
+    {
+        return cpus.empty() ? 0 : cpus[worker % cpus.size()];
+    }
+
+    unsigned node_for_worker(unsigned worker) const
+    {
+        return nodes.empty() ? 0 : nodes[worker % nodes.size()];
+    }
+
+    static bool pin(std::thread& t, unsigned cpu)
+    {
+#if defined(__linux__)
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        return pthread_setaffinity_np(t.native_handle(), sizeof(mask), &mask) == 0;
+#else
+        (void)t; (void)cpu;
+        return false;
+#endif
+    }
+};
+
+
+#endif /* CPU_TOPOLOGY_HPP_ */
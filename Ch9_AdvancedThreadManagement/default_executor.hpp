@@ -0,0 +1,24 @@
+#ifndef DEFAULT_EXECUTOR_HPP_
+#define DEFAULT_EXECUTOR_HPP_
+
+/*
+** The process-wide work-stealing pool used by the parallel algorithms when
+** they are not handed a pool explicitly. It is created on first use, so
+** programs which never run a parallel algorithm never start its threads,
+** and it lives until static destruction, so every later call finds its
+** workers already running.
+*/
+
+#include <algorithm>
+#include <thread>
+#include "work_stealing_thread_pool.hpp"
+
+
+inline thread_pool& default_executor()
+{
+    static thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+
+#endif /* DEFAULT_EXECUTOR_HPP_ */
@@ -0,0 +1,39 @@
+#ifndef DRAIN_POLICY_HPP_
+#define DRAIN_POLICY_HPP_
+
+/*
+** How the thread pools' shutdown() treats the tasks which have not been
+** started yet. Discarded tasks are destroyed without running, so the
+** futures of submitted ones hold broken_promise.
+*/
+
+#include <chrono>
+
+
+enum class drain_mode
+{
+    drain_all,              // run every queued task, however long it takes
+    drain_with_deadline,    // run queued tasks until the deadline, then discard
+    discard                 // run none of the queued tasks
+};
+
+// The tasks submitted by the draining tasks count as queued ones too.
+struct drain_policy
+{
+    drain_mode mode = drain_mode::drain_all;
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+
+    // the point at which the workers stop picking up tasks
+    std::chrono::steady_clock::time_point stop_at() const
+    {
+        return mode == drain_mode::drain_all ?
+                   std::chrono::steady_clock::time_point::max() :
+               mode == drain_mode::discard ?
+                   std::chrono::steady_clock::time_point::min() :
+                   deadline;
+    }
+};
+
+
+#endif /* DRAIN_POLICY_HPP_ */
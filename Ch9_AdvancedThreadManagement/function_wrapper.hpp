@@ -1,49 +1,144 @@
 #ifndef FUNCTION_WRAPPER_HPP_
 #define FUNCTION_WRAPPER_HPP_
 
-#include <thread>
-#include <memory>
+#include <cstddef>
+#include <new>
 #include <utility>
+#include <type_traits>
 
 
-class function_wrapper
+// Move-only type-erased void() callable. Callables of up to buffer_size bytes
+// which can be moved without throwing (typical lambdas, std::packaged_task)
+// are stored inline; anything bigger goes to the heap. Dispatch goes through
+// a pair of plain function pointers rather than a virtual base, so no
+// allocation is needed for the inline case.
+class alignas(64) function_wrapper
 {
-    
-    struct impl_base
+public:
+    static constexpr std::size_t buffer_size = 48;
+
+private:
+    enum class operation { move, destroy };
+    using invoke_type = void (*)(void*);
+    using manage_type = void (*)(operation, void*, void*);
+
+    template<typename Function>
+    static constexpr bool stored_inline =
+        sizeof(Function) <= buffer_size &&
+        alignof(Function) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<Function>::value;
+
+    template<typename Function>
+    struct inline_impl
     {
-        virtual void call() = 0;
-        virtual ~impl_base() = default;
+        static void invoke(void* storage)
+        {
+            (*static_cast<Function*>(storage))();
+        }
+        static void manage(operation op, void* src, void* dst) noexcept
+        {
+            Function* const func = static_cast<Function*>(src);
+            if(op == operation::move){
+                ::new(dst) Function(std::move(*func));
+            }
+            func->~Function();
+        }
     };
 
-// --- member variables
-    std::unique_ptr<impl_base> impl;
-// --- 
     template<typename Function>
-    struct impl_type : public impl_base
+    struct heap_impl
     {
-        Function func;
-        impl_type(Function&& f) : func(std::move(f)) { }
-        void call() { f(); }
+        static Function*& get(void* storage)
+        {
+            return *static_cast<Function**>(storage);
+        }
+        static void invoke(void* storage)
+        {
+            (*get(storage))();
+        }
+        static void manage(operation op, void* src, void* dst) noexcept
+        {
+            if(op == operation::move){
+                ::new(dst) Function*(get(src));
+            }
+            else{
+                delete get(src);
+            }
+        }
     };
 
+// --- member variables
+    alignas(std::max_align_t) unsigned char storage[buffer_size];
+    invoke_type invoke;
+    manage_type manage;
+// ---
+
+    void reset() noexcept
+    {
+        if(manage){
+            manage(operation::destroy, storage, nullptr);
+        }
+        invoke = nullptr;
+        manage = nullptr;
+    }
+
+    void move_from(function_wrapper& other) noexcept
+    {
+        if(other.manage){
+            other.manage(operation::move, other.storage, storage);
+        }
+        invoke = other.invoke;
+        manage = other.manage;
+        other.invoke = nullptr;
+        other.manage = nullptr;
+    }
+
 public:
-    template<typename Function>
+    template<typename Function,
+             typename = std::enable_if_t<
+                !std::is_same<std::decay_t<Function>, function_wrapper>::value>>
     function_wrapper(Function&& f)
-        : impl(new impl_type<Function>(std::move(f)))
-        { }
+    {
+        using impl_function = std::decay_t<Function>;
+        if constexpr(stored_inline<impl_function>){
+            ::new(storage) impl_function(std::forward<Function>(f));
+            invoke = &inline_impl<impl_function>::invoke;
+            manage = &inline_impl<impl_function>::manage;
+        }
+        else{
+            ::new(storage) impl_function*(
+                new impl_function(std::forward<Function>(f)));
+            invoke = &heap_impl<impl_function>::invoke;
+            manage = &heap_impl<impl_function>::manage;
+        }
+    }
 
-    void operator()() { impl->call(); }
+    void operator()() { invoke(storage); }
 
-    function_wrapper() = default;
-    function_wrapper( function_wrapper&& other ) noexcept
-        : impl(std::move(other.impl))
+    explicit operator bool() const noexcept { return invoke != nullptr; }
+
+    function_wrapper() noexcept
+        : invoke(nullptr), manage(nullptr)
         { }
+    function_wrapper( function_wrapper&& other ) noexcept
+        : invoke(nullptr), manage(nullptr)
+    {
+        move_from(other);
+    }
     function_wrapper& operator=(function_wrapper&& other) noexcept
     {
-        impl = std::move(other.impl);
+        if(this != &other){
+            reset();
+            move_from(other);
+        }
         return *this;
     }
 
+    ~function_wrapper()
+    {
+        reset();
+    }
+
     function_wrapper(const function_wrapper&) = delete;
     function_wrapper& operator=(const function_wrapper&) = delete;
 
@@ -0,0 +1,213 @@
+#ifndef IDLE_POLICY_HPP_
+#define IDLE_POLICY_HPP_
+
+/*
+** Idle handling shared by the thread pools. A worker that finds no work first
+** spins for a while with a pause instruction (cheap, and keeps wake-up latency
+** at zero for bursty submissions), then yields for a few rounds, and finally
+** parks on an event_count. Submitters only pay for a wake-up - a fence and a
+** load - unless some worker is actually parked.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+
+struct idle_policy
+{
+    unsigned spin_rounds = 128;  // failed polls followed by cpu_relax()
+    unsigned yield_rounds = 8;   // then failed polls followed by yield()
+    bool park = true;            // then park; false keeps yielding forever
+};
+
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+
+// Lets a thread sleep until a condition it cannot atomically check becomes
+// true. The waiter registers with prepare_wait(), re-checks the condition and
+// then either cancel_wait()s or commit_wait()s. A notifier changes the state
+// first and then calls notify_*(), which returns right away if nobody is
+// registered.
+// Several event_counts can share a total of their waiters, so that whoever
+// notifies one of a group can tell with a single load that none of them has
+// any.
+class event_count
+{
+    std::atomic<unsigned> epoch;
+    std::atomic<unsigned> waiters;
+    std::atomic<unsigned>* const group_waiters;
+    std::mutex mtx;
+    std::condition_variable cond;
+
+    void unregister() noexcept
+    {
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        if(group_waiters){
+            group_waiters->fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void bump_and_wake(std::size_t count)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const unsigned waiting = waiters.load(std::memory_order_relaxed);
+        if(waiting == 0 || count == 0){
+            return;
+        }
+        epoch.fetch_add(1, std::memory_order_release);
+        // taking the lock orders the epoch change with a waiter that has
+        // checked it but not yet gone to sleep
+        { std::lock_guard<std::mutex> lk(mtx); }
+        if(count >= waiting){
+            cond.notify_all();
+        }
+        else{
+            for(std::size_t i=0; i<count; ++i){
+                cond.notify_one();
+            }
+        }
+    }
+
+public:
+    explicit event_count(std::atomic<unsigned>* group_waiters_ = nullptr)
+        : epoch(0), waiters(0), group_waiters(group_waiters_)
+        { }
+    event_count(const event_count&) = delete;
+    event_count& operator=(const event_count&) = delete;
+
+    unsigned prepare_wait() noexcept
+    {
+        if(group_waiters){
+            group_waiters->fetch_add(1, std::memory_order_seq_cst);
+        }
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        // pairs with the fence in bump_and_wake(): either the notifier sees
+        // us registered, or our re-check of the condition sees its change
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_acquire);
+    }
+
+    void cancel_wait() noexcept
+    {
+        unregister();
+    }
+
+    void commit_wait(unsigned key)
+    {
+        { std::unique_lock<std::mutex> lk(mtx);
+            cond.wait(lk, [this, key]{
+                return epoch.load(std::memory_order_acquire) != key; });
+        }
+        unregister();
+    }
+
+    // returns false if timeout passed without a notification
+    template<typename Rep, typename Period>
+    bool commit_wait_for(unsigned key,
+                         const std::chrono::duration<Rep,Period>& timeout)
+    {
+        bool notified;
+        { std::unique_lock<std::mutex> lk(mtx);
+            notified = cond.wait_for(lk, timeout, [this, key]{
+                return epoch.load(std::memory_order_acquire) != key; });
+        }
+        unregister();
+        return notified;
+    }
+
+    void notify_one() { bump_and_wake(1); }
+    void notify_all() { bump_and_wake(std::numeric_limits<std::size_t>::max()); }
+    // wakes up to count waiters with a single epoch change
+    void notify(std::size_t count) { bump_and_wake(count); }
+
+    bool has_waiters() const noexcept
+    {
+        return waiters.load(std::memory_order_relaxed) != 0;
+    }
+};
+
+
+// Per-worker idle state; reset() it whenever a task has been run.
+class idle_backoff
+{
+    const idle_policy policy;
+    unsigned rounds;
+
+public:
+    explicit idle_backoff(const idle_policy& policy_)
+        : policy(policy_), rounds(0)
+        { }
+
+    void reset() noexcept { rounds = 0; }
+
+    // wake_condition has to return true once there is work (or the pool is
+    // shutting down), it is re-checked after registering as a waiter
+    template<typename Predicate>
+    void idle(event_count& wakeup, Predicate wake_condition)
+    {
+        if(rounds < policy.spin_rounds){
+            ++rounds;
+            cpu_relax();
+        }
+        else if(rounds < policy.spin_rounds + policy.yield_rounds ||
+                !policy.park){
+            ++rounds;
+            std::this_thread::yield();
+        }
+        else{
+            const unsigned key = wakeup.prepare_wait();
+            if(wake_condition()){
+                wakeup.cancel_wait();
+            }
+            else{
+                wakeup.commit_wait(key);
+            }
+            rounds = 0;
+        }
+    }
+
+    // As idle(), but parks for at most max_park. Returns false if it parked
+    // and nothing woke it up, i.e. the caller has been idle for a while.
+    template<typename Predicate, typename Rep, typename Period>
+    bool idle_for(event_count& wakeup, Predicate wake_condition,
+                  const std::chrono::duration<Rep,Period>& max_park)
+    {
+        if(rounds < policy.spin_rounds + policy.yield_rounds || !policy.park){
+            idle(wakeup, wake_condition);
+            return true;
+        }
+        bool woken = true;
+        const unsigned key = wakeup.prepare_wait();
+        if(wake_condition()){
+            wakeup.cancel_wait();
+        }
+        else{
+            woken = wakeup.commit_wait_for(key, max_park);
+        }
+        rounds = 0;
+        return woken;
+    }
+};
+
+
+#endif /* IDLE_POLICY_HPP_ */
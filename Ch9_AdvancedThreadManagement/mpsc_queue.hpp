@@ -0,0 +1,101 @@
+#ifndef MPSC_QUEUE_HPP_
+#define MPSC_QUEUE_HPP_
+
+/*
+** Unbounded multi-producer queue after Dmitry Vyukov's node-based MPSC
+** queue. push() is wait-free: a single exchange on the head. Popping is only
+** safe for one consumer at a time. try_pop() enforces that with a try-lock,
+** so any thread may call it, and it fails rather than waits if another
+** consumer is active.
+** Right after a push there is a short window in which the new node is not
+** yet linked in. try_pop() may then fail although empty() already reports
+** the queue as non-empty.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+
+template<typename T>
+class mpsc_queue
+{
+    struct node
+    {
+        std::atomic<node*> next;
+        T value;
+
+        node() : next(nullptr) { }
+        explicit node(T value_) : next(nullptr), value(std::move(value_)) { }
+    };
+
+    // producers only touch head, the consumer only tail
+    alignas(64) std::atomic<node*> head;
+    alignas(64) std::atomic<node*> tail;    // the stub, its value is spent
+    std::atomic<bool> consuming;
+    std::atomic<std::size_t> count;
+
+public:
+    mpsc_queue()
+        : consuming(false), count(0)
+    {
+        node* const stub = new node;
+        head.store(stub, std::memory_order_relaxed);
+        tail.store(stub, std::memory_order_relaxed);
+    }
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    ~mpsc_queue()
+    {
+        node* n = tail.load(std::memory_order_relaxed);
+        while(n){
+            node* const next = n->next.load(std::memory_order_relaxed);
+            delete n;
+            n = next;
+        }
+    }
+
+    void push(T value)
+    {
+        node* const n = new node(std::move(value));
+        count.fetch_add(1, std::memory_order_relaxed);
+        node* const prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    bool try_pop(T& value)
+    {
+        if(empty() || consuming.exchange(true, std::memory_order_acquire)){
+            return false;
+        }
+        node* const stub = tail.load(std::memory_order_relaxed);
+        node* const next = stub->next.load(std::memory_order_acquire);
+        if(!next){
+            consuming.store(false, std::memory_order_release);
+            return false;
+        }
+        value = std::move(next->value);
+        tail.store(next, std::memory_order_relaxed);
+        count.fetch_sub(1, std::memory_order_relaxed);
+        consuming.store(false, std::memory_order_release);
+        delete stub;
+        return true;
+    }
+
+    // both are only a snapshot when other threads are active
+    bool empty() const noexcept
+    {
+        return head.load(std::memory_order_acquire) ==
+               tail.load(std::memory_order_relaxed);
+    }
+
+    std::size_t size() const noexcept
+    {
+        return count.load(std::memory_order_relaxed);
+    }
+};
+
+
+#endif /* MPSC_QUEUE_HPP_ */
@@ -2,9 +2,12 @@
 #define PARALLEL_ACCUMULATE_WAITABLE_POOL_HPP_
 
 #include <algorithm>
+#include <iterator>
+#include <numeric>
 #include <vector>
-#include <future>
-#include "waitable_thread_pool.hpp"
+#include "work_stealing_thread_pool.hpp"
+#include "default_executor.hpp"
+#include "task_group.hpp"
 
 
 template<typename Iterator, typename T>
@@ -16,8 +19,12 @@ struct accumulate_block
     }
 };
 
+// The caller runs pending pool tasks while it waits for the blocks, so this
+// may also be called from inside a pool task. Once a block has thrown, the
+// blocks not yet started are skipped, and the exceptions of those which
+// did run are rethrown together (see task_group::wait()).
 template<typename Iterator, typename T>
-T parallel_accumulate( Iterator first, Iterator last, T init )
+T parallel_accumulate( thread_pool& pool, Iterator first, Iterator last, T init )
 {
     const unsigned long length = std::distance(first, last);
 
@@ -27,25 +34,32 @@ T parallel_accumulate( Iterator first, Iterator last, T init )
     const unsigned long block_size = 25;
     const unsigned long num_blocks = (length+block_size-1)/block_size;
 
-    std::vector<std::future<T>> futures; futures.reserve(num_blocks-1);
-    thread_pool pool;
+    std::vector<T> results(num_blocks);
+    task_group blocks(pool, failure_policy::fail_fast);
 
     Iterator block_start = first;
-    for(unsigned long i=0; i<(num_blocks-1); ++i){
+    for(unsigned long i=0; i<num_blocks; ++i){
         Iterator block_end = block_start;
-        std::advance(block_end, block_size);
-        futures.push_back(accumulate_block<Iterator,T>());
+        std::advance(block_end, std::min(block_size, length - i*block_size));
+        T* const result = &results[i];
+        blocks.spawn([block_start, block_end, result]{
+            *result = accumulate_block<Iterator,T>()(block_start, block_end); });
         block_start = block_end;
     }
+    blocks.wait();
 
-    T last_result = accumulate_block<Iterator,T>()(block_start, last);
     T result = init;
-    for(unsigned long i=0; i<(num_blocks-1); ++i){
-        result += futures[i].get();
+    for(auto& block_result : results){
+        result += block_result;
     }
-    result += last_result;
     return result;
 }
 
+template<typename Iterator, typename T>
+T parallel_accumulate( Iterator first, Iterator last, T init )
+{
+    return parallel_accumulate(default_executor(), first, last, init);
+}
+
 
 #endif /* PARALLEL_ACCUMULATE_WAITABLE_POOL_HPP_ */
@@ -3,13 +3,21 @@
 
 #include <algorithm>
 #include <list>
-#include "waitable_thread_pool.hpp"
+#include <utility>
+#include "work_stealing_thread_pool.hpp"
+#include "task_group.hpp"
+#include "default_executor.hpp"
 
 
 template<typename T>
 struct sorter
 {
-    thread_pool pool;
+    thread_pool& pool;
+
+    explicit sorter(thread_pool& pool_)
+        : pool(pool_)
+        { }
+
     std::list<T> do_sort(std::list<T>& data_chunk)
     {
         if(data_chunk.empty()){
@@ -28,29 +36,35 @@ struct sorter
                                data_chunk, data_chunk.begin(),
                                divide_point);
 
-        std::future<std::list<T>> new_lower =
-            pool.submit([this, new_lower_chunk=std::move(new_lower_chunk)]
-                        {do_sort(new_lower_chunk);});
-        
+        // wait() runs other pending chunks instead of blocking
+        std::list<T> new_lower;
+        task_group children(pool);
+        children.spawn([this, &new_lower,
+                        new_lower_chunk=std::move(new_lower_chunk)]() mutable
+                       { new_lower = do_sort(new_lower_chunk); });
+
         std::list<T> new_higher(do_sort(data_chunk));
         result.splice(result.end(), new_higher);
-        while(!new_lower.wait_for(std::chrono::second(0)) ==
-                std::future_status::timeout){
-            pool.run_pending_task();
-        }
-        result.splice(result.begin(), new_lower.get());
+        children.wait();
+        result.splice(result.begin(), new_lower);
         return result;
     }
 };
 
 template<typename T>
-std::list<T> parallel_quicksort(std::list<T> input)
+std::list<T> parallel_quicksort(thread_pool& pool, std::list<T> input)
 {
     if(input.empty()){
         return input;
     }
-    sorter<T> s;
+    sorter<T> s(pool);
     return s.do_sort(input);
 }
 
+template<typename T>
+std::list<T> parallel_quicksort(std::list<T> input)
+{
+    return parallel_quicksort(default_executor(), std::move(input));
+}
+
 #endif /* PARALLEL_QUICKSORT_THREAD_POOL_HPP_ */
@@ -0,0 +1,495 @@
+#ifndef POOL_BENCHMARK_HPP_
+#define POOL_BENCHMARK_HPP_
+
+/*
+** Benchmark harness shared by the bench_* programs, one per thread pool
+** variant - every pool header defines its own class thread_pool, so each
+** program includes exactly one of them and hands it to run_pool_benchmarks().
+**
+** Workloads:
+**   empty      throughput of empty tasks submitted from one outside thread
+**   producers  the same, submitted by several outside threads at once
+**   latency    submit-to-start latency percentiles of single spaced-out tasks
+**   fib        recursive fork-join, a task per call above a cutoff
+**   quicksort  recursive fork-join over a vector of random ints
+**   tree       fork-join over a deliberately lopsided tree
+** The fork-join workloads wait for their children by running pending tasks,
+** so they are skipped for pools which have no run_pending_task().
+**
+** Options: --threads=1,2,4  --tasks=N  --repeat=N  --format=csv|json
+**          --only=fib,tree  (comma separated workload names)
+** Each row reports the median of the repetitions. Build with optimizations
+** (-DCMAKE_BUILD_TYPE=Release) for numbers worth comparing.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+struct benchmark_options
+{
+    std::vector<unsigned> thread_counts;
+    std::size_t tasks = 200000;
+    unsigned repetitions = 3;
+    bool json = false;
+    std::vector<std::string> only;
+
+    bool selected(const std::string& name) const
+    {
+        return only.empty() ||
+               std::find(only.begin(), only.end(), name) != only.end();
+    }
+};
+
+struct benchmark_result
+{
+    std::string pool;
+    std::string workload;
+    unsigned threads = 0;
+    std::size_t operations = 0;     // tasks, or calls for the fork-join ones
+    double seconds = 0;
+    // latency workload only, in microseconds
+    bool has_latency = false;
+    double p50_us = 0;
+    double p90_us = 0;
+    double p99_us = 0;
+    double max_us = 0;
+
+    double operations_per_second() const
+    {
+        return seconds > 0 ? operations / seconds : 0;
+    }
+};
+
+
+namespace pool_benchmark_detail
+{
+
+using clock = std::chrono::steady_clock;
+
+template<typename Pool, typename = void>
+struct can_help : std::false_type { };
+
+template<typename Pool>
+struct can_help<Pool,
+    std::void_t<decltype(std::declval<Pool&>().run_pending_task())>>
+    : std::true_type { };
+
+inline std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> res;
+    std::string::size_type start = 0;
+    while(start <= list.size()){
+        const std::string::size_type comma = list.find(',', start);
+        const std::string::size_type end =
+            comma == std::string::npos ? list.size() : comma;
+        if(end != start){
+            res.push_back(list.substr(start, end-start));
+        }
+        start = end+1;
+    }
+    return res;
+}
+
+inline benchmark_options parse_options(int argc, char* argv[])
+{
+    benchmark_options res;
+    for(int i=1; i<argc; ++i){
+        const std::string arg(argv[i]);
+        const std::string::size_type eq = arg.find('=');
+        const std::string name = arg.substr(0, eq);
+        const std::string value =
+            eq == std::string::npos ? std::string() : arg.substr(eq+1);
+        if(name == "--threads"){
+            for(const auto& count : split(value)){
+                res.thread_counts.push_back(
+                    static_cast<unsigned>(std::stoul(count)));
+            }
+        }
+        else if(name == "--tasks"){
+            res.tasks = std::stoul(value);
+        }
+        else if(name == "--repeat"){
+            res.repetitions = std::max(1ul, std::stoul(value));
+        }
+        else if(name == "--format"){
+            res.json = value == "json";
+        }
+        else if(name == "--only"){
+            res.only = split(value);
+        }
+        else{
+            std::cerr << "unknown option " << arg << "\n"
+                      << "usage: " << argv[0] << " [--threads=1,2,4]"
+                      << " [--tasks=N] [--repeat=N] [--format=csv|json]"
+                      << " [--only=empty,producers,latency,fib,quicksort,tree]\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    if(res.thread_counts.empty()){
+        const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        for(unsigned count=1; count<hw; count*=2){
+            res.thread_counts.push_back(count);
+        }
+        res.thread_counts.push_back(hw);
+    }
+    return res;
+}
+
+// Waits for the future; a pool which can run pending tasks is helped out
+// meanwhile, so this may be called from inside a task.
+template<typename Pool, typename Future>
+auto wait_for(Pool& pool, Future& res)
+{
+    if constexpr(can_help<Pool>::value){
+        while(res.wait_for(std::chrono::seconds(0)) !=
+              std::future_status::ready){
+            pool.run_pending_task();
+        }
+    }
+    return res.get();
+}
+
+template<typename Pool>
+void wait_until_count(Pool& pool, const std::atomic<std::size_t>& count,
+                      std::size_t expected)
+{
+    while(count.load(std::memory_order_acquire) != expected){
+        if constexpr(can_help<Pool>::value){
+            pool.run_pending_task();
+        }
+        else{
+            std::this_thread::yield();
+        }
+    }
+}
+
+template<typename Function>
+double time_seconds(Function f)
+{
+    const auto start = clock::now();
+    f();
+    return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+inline double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size()/2];
+}
+
+// nearest rank on a sorted sample
+inline double percentile(const std::vector<double>& sorted, double p)
+{
+    return sorted[static_cast<std::size_t>(p * (sorted.size()-1) + 0.5)];
+}
+
+// a little work which the optimizer cannot remove
+inline std::uint64_t spin_work(std::uint64_t seed, unsigned rounds)
+{
+    for(unsigned i=0; i<rounds; ++i){
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    return seed;
+}
+
+
+template<typename Pool>
+double run_empty(Pool& pool, std::size_t tasks)
+{
+    std::atomic<std::size_t> ran(0);
+    return time_seconds([&]{
+        for(std::size_t i=0; i<tasks; ++i){
+            pool.submit([&ran]{ ran.fetch_add(1, std::memory_order_release); });
+        }
+        wait_until_count(pool, ran, tasks);
+    });
+}
+
+template<typename Pool>
+double run_producers(Pool& pool, std::size_t tasks, unsigned producer_count)
+{
+    std::atomic<std::size_t> ran(0);
+    const std::size_t per_producer = tasks / producer_count;
+    return time_seconds([&]{
+        std::vector<std::thread> producers;
+        for(unsigned p=0; p<producer_count; ++p){
+            producers.emplace_back([&pool, &ran, per_producer]{
+                for(std::size_t i=0; i<per_producer; ++i){
+                    pool.submit([&ran]{
+                        ran.fetch_add(1, std::memory_order_release); });
+                }
+            });
+        }
+        for(auto& producer : producers){
+            producer.join();
+        }
+        wait_until_count(pool, ran, per_producer * producer_count);
+    });
+}
+
+// Submits the samples one at a time, spaced out so that the workers have
+// gone idle (and possibly parked) by the time the next one arrives.
+template<typename Pool>
+std::vector<double> run_latency(Pool& pool, std::size_t samples)
+{
+    std::vector<double> latencies(samples);
+    std::atomic<std::size_t> ran(0);
+    for(std::size_t i=0; i<samples; ++i){
+        const auto submitted = clock::now();
+        double* const latency = &latencies[i];
+        pool.submit([&ran, submitted, latency]{
+            *latency = std::chrono::duration<double, std::micro>(
+                clock::now() - submitted).count();
+            ran.fetch_add(1, std::memory_order_release);
+        });
+        while(ran.load(std::memory_order_acquire) != i+1){
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+template<typename Pool>
+std::uint64_t fib(Pool& pool, unsigned n)
+{
+    if(n < 2){
+        return n;
+    }
+    if(n < 16){
+        return fib(pool, n-1) + fib(pool, n-2);
+    }
+    auto first = pool.submit([&pool, n]{ return fib(pool, n-1); });
+    const std::uint64_t second = fib(pool, n-2);
+    return wait_for(pool, first) + second;
+}
+
+// calls made by fib(n)
+inline std::size_t fib_calls(unsigned n)
+{
+    return n < 2 ? 1 : 1 + fib_calls(n-1) + fib_calls(n-2);
+}
+
+template<typename Pool, typename Iterator>
+void quicksort(Pool& pool, Iterator first, Iterator last)
+{
+    if(last - first < 4096){
+        std::sort(first, last);
+        return;
+    }
+    const auto pivot = *(first + (last-first)/2);
+    const Iterator middle1 = std::partition(first, last,
+        [pivot](const auto& x){ return x < pivot; });
+    const Iterator middle2 = std::partition(middle1, last,
+        [pivot](const auto& x){ return !(pivot < x); });
+    auto lower = pool.submit([&pool, first, middle1]{
+        quicksort(pool, first, middle1); });
+    quicksort(pool, middle2, last);
+    wait_for(pool, lower);
+}
+
+// Node depth d has children of depth d-1, d-2 and d-3, so the first subtree
+// holds most of the work and the split is uneven at every level.
+template<typename Pool>
+std::uint64_t lopsided_tree(Pool& pool, int depth)
+{
+    if(depth <= 0){
+        return spin_work(static_cast<std::uint64_t>(-depth) + 1, 500);
+    }
+    // small subtrees are not worth a task - and waiting helpers nest the
+    // tasks they run on their stack, so they must not be too many
+    if(depth < 10){
+        return lopsided_tree(pool, depth-1) + lopsided_tree(pool, depth-2) +
+               lopsided_tree(pool, depth-3);
+    }
+    auto subtree = [&pool, depth](int i){
+        return pool.submit([&pool, depth, i]{
+            return lopsided_tree(pool, depth-i); });
+    };
+    std::vector<decltype(subtree(1))> children;
+    for(int i=1; i<3; ++i){
+        children.push_back(subtree(i));
+    }
+    std::uint64_t res = lopsided_tree(pool, depth-3);
+    for(auto& child : children){
+        res += wait_for(pool, child);
+    }
+    return res;
+}
+
+inline std::size_t lopsided_tree_nodes(int depth)
+{
+    return depth <= 0 ? 1 : 1 + lopsided_tree_nodes(depth-1) +
+                            lopsided_tree_nodes(depth-2) +
+                            lopsided_tree_nodes(depth-3);
+}
+
+
+inline void print_csv_header()
+{
+    std::cout << "pool,workload,threads,operations,seconds,ops_per_second,"
+                 "p50_us,p90_us,p99_us,max_us\n";
+}
+
+inline void print_csv(const benchmark_result& r)
+{
+    std::cout << r.pool << ',' << r.workload << ',' << r.threads << ','
+              << r.operations << ',' << r.seconds << ','
+              << r.operations_per_second() << ',';
+    if(r.has_latency){
+        std::cout << r.p50_us << ',' << r.p90_us << ','
+                  << r.p99_us << ',' << r.max_us;
+    }
+    else{
+        std::cout << ",,,";
+    }
+    std::cout << '\n';
+}
+
+inline void print_json(const std::vector<benchmark_result>& results)
+{
+    std::cout << "[\n";
+    for(std::size_t i=0; i<results.size(); ++i){
+        const benchmark_result& r = results[i];
+        std::cout << "  {\"pool\": \"" << r.pool << "\", \"workload\": \""
+                  << r.workload << "\", \"threads\": " << r.threads
+                  << ", \"operations\": " << r.operations
+                  << ", \"seconds\": " << r.seconds
+                  << ", \"ops_per_second\": " << r.operations_per_second();
+        if(r.has_latency){
+            std::cout << ", \"p50_us\": " << r.p50_us
+                      << ", \"p90_us\": " << r.p90_us
+                      << ", \"p99_us\": " << r.p99_us
+                      << ", \"max_us\": " << r.max_us;
+        }
+        std::cout << '}' << (i+1 < results.size() ? "," : "") << '\n';
+    }
+    std::cout << "]\n";
+}
+
+} // namespace pool_benchmark_detail
+
+
+// Runs the selected workloads on a fresh Pool for every thread count and
+// prints a row per workload and thread count - CSV rows as they complete,
+// JSON once at the end. Returns the exit status for main().
+template<typename Pool>
+int run_pool_benchmarks(const std::string& pool_name, int argc, char* argv[])
+{
+    using namespace pool_benchmark_detail;
+    const benchmark_options options = parse_options(argc, argv);
+    std::vector<benchmark_result> results;
+
+    if(!options.json){
+        print_csv_header();
+    }
+    auto report = [&](benchmark_result r){
+        if(!options.json){
+            print_csv(r);
+            std::cout.flush();
+        }
+        results.push_back(std::move(r));
+    };
+    // median time over the repetitions, each on a fresh pool
+    auto measure = [&](const std::string& workload, unsigned threads,
+                       std::size_t operations, auto run){
+        std::vector<double> times;
+        for(unsigned rep=0; rep<options.repetitions; ++rep){
+            Pool pool(threads);
+            times.push_back(run(pool));
+        }
+        benchmark_result r;
+        r.pool = pool_name;
+        r.workload = workload;
+        r.threads = threads;
+        r.operations = operations;
+        r.seconds = median(times);
+        report(std::move(r));
+    };
+
+    for(const unsigned threads : options.thread_counts){
+        if(options.selected("empty")){
+            measure("empty", threads, options.tasks, [&](Pool& pool){
+                return run_empty(pool, options.tasks); });
+        }
+        if(options.selected("producers")){
+            const unsigned producers = std::max(4u, threads);
+            const std::size_t tasks = options.tasks / producers * producers;
+            measure("producers", threads, tasks, [&](Pool& pool){
+                return run_producers(pool, tasks, producers); });
+        }
+        if(options.selected("latency")){
+            Pool pool(threads);
+            const std::size_t samples =
+                std::max<std::size_t>(options.tasks / 100, 100);
+            const auto start = clock::now();
+            const std::vector<double> latencies = run_latency(pool, samples);
+            benchmark_result r;
+            r.pool = pool_name;
+            r.workload = "latency";
+            r.threads = threads;
+            r.operations = samples;
+            r.seconds = std::chrono::duration<double>(clock::now()-start).count();
+            r.has_latency = true;
+            r.p50_us = percentile(latencies, 0.50);
+            r.p90_us = percentile(latencies, 0.90);
+            r.p99_us = percentile(latencies, 0.99);
+            r.max_us = latencies.back();
+            report(std::move(r));
+        }
+        if constexpr(can_help<Pool>::value){
+            if(options.selected("fib")){
+                const unsigned n = 30;
+                measure("fib", threads, fib_calls(n), [&](Pool& pool){
+                    return time_seconds([&]{ fib(pool, n); }); });
+            }
+            if(options.selected("quicksort")){
+                const std::size_t size = 1000000;
+                measure("quicksort", threads, size, [&](Pool& pool){
+                    std::vector<int> data(size);
+                    std::mt19937 gen(42);
+                    for(auto& x : data){
+                        x = static_cast<int>(gen());
+                    }
+                    const double seconds = time_seconds([&]{
+                        quicksort(pool, data.begin(), data.end()); });
+                    if(!std::is_sorted(data.begin(), data.end())){
+                        std::cerr << "quicksort produced unsorted output\n";
+                        std::exit(EXIT_FAILURE);
+                    }
+                    return seconds;
+                });
+            }
+            if(options.selected("tree")){
+                const int depth = 20;
+                measure("tree", threads, lopsided_tree_nodes(depth),
+                        [&](Pool& pool){
+                    return time_seconds([&]{ lopsided_tree(pool, depth); }); });
+            }
+        }
+    }
+
+    if(options.json){
+        print_json(results);
+    }
+    return EXIT_SUCCESS;
+}
+
+
+#endif /* POOL_BENCHMARK_HPP_ */
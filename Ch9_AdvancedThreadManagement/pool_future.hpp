@@ -0,0 +1,335 @@
+#ifndef POOL_FUTURE_HPP_
+#define POOL_FUTURE_HPP_
+
+/*
+** The future returned by the work-stealing thread_pool's submit().
+** Task and result share one allocation: the callable is stored right next
+** to the slot for its result, and the task queued on the pool is a single
+** pointer to it, so it fits function_wrapper's inline buffer. Readiness is
+** one atomic word rather than a mutex and condition variable. The state is
+** freed by whichever of the task and the future lets go of it last.
+** A thread waiting on the future runs the pool's pending tasks meanwhile.
+** Once there are none, a thread outside the pool sleeps on the state word
+** until the result is in; the pool's own workers keep polling instead, as
+** they may be the ones needed to fire a due timer.
+** If the task is destroyed without having run - the pool was shut down
+** before it got to it - the future holds broken_promise, like std::future.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "idle_policy.hpp"
+
+
+// How a pool_future waits on the pool which runs its task.
+struct pool_future_waiter
+{
+    bool (*try_help)(void* pool);   // runs one pending task, false if none
+    bool (*may_sleep)(void* pool);  // false on the pool's own workers
+};
+
+
+namespace pool_future_detail
+{
+
+struct no_value { };
+
+template<typename T>
+class shared_state
+{
+    using stored_type = std::conditional_t<std::is_void<T>::value, no_value, T>;
+
+    static constexpr unsigned pending = 0;
+    static constexpr unsigned ready = 1;
+
+    std::atomic<unsigned> status;
+    std::atomic<unsigned> refs;     // held by the task and by the future
+    std::optional<stored_type> value;
+    std::exception_ptr error;
+
+protected:
+    template<typename Function>
+    void store_result(Function& f) noexcept
+    {
+        try{
+            if constexpr(std::is_void<T>::value){
+                f();
+                value.emplace();
+            }
+            else{
+                value.emplace(f());
+            }
+        }
+        catch(...){
+            error = std::current_exception();
+        }
+    }
+
+    void store_broken_promise() noexcept
+    {
+        error = std::make_exception_ptr(
+            std::future_error(std::future_errc::broken_promise));
+    }
+
+    void make_ready() noexcept
+    {
+        status.store(ready, std::memory_order_release);
+        status.notify_all();
+    }
+
+public:
+    shared_state() noexcept
+        : status(pending), refs(2)
+        { }
+
+    shared_state(const shared_state&) = delete;
+    shared_state& operator=(const shared_state&) = delete;
+
+    virtual ~shared_state() = default;
+
+    // each makes the state ready, exactly one of them is called
+    virtual void run() noexcept = 0;
+    virtual void abandon() noexcept = 0;
+
+    bool is_ready() const noexcept
+    {
+        return status.load(std::memory_order_acquire) == ready;
+    }
+
+    void sleep_until_ready() const noexcept
+    {
+        while(status.load(std::memory_order_acquire) == pending){
+            status.wait(pending, std::memory_order_acquire);
+        }
+    }
+
+    void release() noexcept
+    {
+        if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            delete this;
+        }
+    }
+
+    // only once ready, and only once
+    T take()
+    {
+        if(error){
+            std::rethrow_exception(error);
+        }
+        if constexpr(!std::is_void<T>::value){
+            return std::move(*value);
+        }
+    }
+};
+
+template<typename T, typename Function>
+class task_state final : public shared_state<T>
+{
+    // destroyed as soon as it has run, not when the future lets go
+    std::optional<Function> func;
+
+public:
+    explicit task_state(Function&& f)
+        : func(std::move(f))
+        { }
+
+    void run() noexcept override
+    {
+        this->store_result(*func);
+        func.reset();
+        this->make_ready();
+    }
+
+    void abandon() noexcept override
+    {
+        func.reset();
+        this->store_broken_promise();
+        this->make_ready();
+    }
+};
+
+} // namespace pool_future_detail
+
+
+// The queued half: runs the task once, or breaks the promise if it is
+// destroyed without having run.
+template<typename T>
+class pool_future_task
+{
+    pool_future_detail::shared_state<T>* state;
+
+public:
+    explicit pool_future_task(pool_future_detail::shared_state<T>* state_) noexcept
+        : state(state_)
+        { }
+
+    pool_future_task(pool_future_task&& other) noexcept
+        : state(std::exchange(other.state, nullptr))
+        { }
+
+    pool_future_task(const pool_future_task&) = delete;
+    pool_future_task& operator=(const pool_future_task&) = delete;
+    pool_future_task& operator=(pool_future_task&&) = delete;
+
+    ~pool_future_task()
+    {
+        if(state){
+            state->abandon();
+            state->release();
+        }
+    }
+
+    void operator()()
+    {
+        pool_future_detail::shared_state<T>* const running =
+            std::exchange(state, nullptr);
+        running->run();
+        running->release();
+    }
+};
+
+
+template<typename T>
+class pool_future
+{
+    pool_future_detail::shared_state<T>* state;
+    void* pool;
+    const pool_future_waiter* waiter;
+
+    pool_future(pool_future_detail::shared_state<T>* state_, void* pool_,
+                const pool_future_waiter* waiter_) noexcept
+        : state(state_), pool(pool_), waiter(waiter_)
+        { }
+
+    template<typename Function>
+    friend auto make_pool_future_task(Function f, void* pool,
+                                      const pool_future_waiter* waiter);
+
+public:
+    pool_future() noexcept
+        : state(nullptr), pool(nullptr), waiter(nullptr)
+        { }
+
+    pool_future(pool_future&& other) noexcept
+        : state(std::exchange(other.state, nullptr))
+        , pool(other.pool), waiter(other.waiter)
+        { }
+
+    pool_future& operator=(pool_future&& other) noexcept
+    {
+        if(this != &other){
+            if(state){
+                state->release();
+            }
+            state = std::exchange(other.state, nullptr);
+            pool = other.pool;
+            waiter = other.waiter;
+        }
+        return *this;
+    }
+
+    pool_future(const pool_future&) = delete;
+    pool_future& operator=(const pool_future&) = delete;
+
+    ~pool_future()
+    {
+        if(state){
+            state->release();
+        }
+    }
+
+    bool valid() const noexcept
+    {
+        return state != nullptr;
+    }
+
+    bool is_ready() const noexcept
+    {
+        return state->is_ready();
+    }
+
+    void wait() const
+    {
+        const idle_policy idle;
+        unsigned rounds = 0;
+        while(!state->is_ready()){
+            if(waiter->try_help(pool)){
+                rounds = 0;
+            }
+            else if(rounds < idle.spin_rounds){
+                ++rounds;
+                cpu_relax();
+            }
+            else if(rounds < idle.spin_rounds + idle.yield_rounds ||
+                    !waiter->may_sleep(pool)){
+                ++rounds;
+                std::this_thread::yield();
+            }
+            else{
+                state->sleep_until_ready();
+            }
+        }
+    }
+
+    // helps out until the result is in or the deadline has passed, but
+    // never sleeps
+    template<typename Clock, typename Duration>
+    std::future_status
+    wait_until(const std::chrono::time_point<Clock,Duration>& deadline) const
+    {
+        while(!state->is_ready()){
+            if(Clock::now() >= deadline){
+                return std::future_status::timeout;
+            }
+            if(!waiter->try_help(pool)){
+                std::this_thread::yield();
+            }
+        }
+        return std::future_status::ready;
+    }
+
+    template<typename Rep, typename Period>
+    std::future_status
+    wait_for(const std::chrono::duration<Rep,Period>& timeout) const
+    {
+        return wait_until(std::chrono::steady_clock::now() + timeout);
+    }
+
+    // Waits, then returns the result or rethrows the task's exception. The
+    // future is no longer valid afterwards.
+    T get()
+    {
+        wait();
+        pool_future_detail::shared_state<T>* const ready =
+            std::exchange(state, nullptr);
+        struct release_on_exit
+        {
+            pool_future_detail::shared_state<T>* state;
+            ~release_on_exit() { state->release(); }
+        } guard{ready};
+        return ready->take();
+    }
+};
+
+
+// Allocates the shared state of f's task and result at once; returns the
+// task to queue and the future for its result.
+template<typename Function>
+auto make_pool_future_task(Function f, void* pool,
+                           const pool_future_waiter* waiter)
+{
+    using result_type = std::invoke_result_t<Function&>;
+    auto* const state =
+        new pool_future_detail::task_state<result_type, Function>(std::move(f));
+    return std::make_pair(pool_future_task<result_type>(state),
+                          pool_future<result_type>(state, pool, waiter));
+}
+
+
+#endif /* POOL_FUTURE_HPP_ */
@@ -0,0 +1,127 @@
+#ifndef POOL_METRICS_HPP_
+#define POOL_METRICS_HPP_
+
+/*
+** Per-worker counters for the thread pools. Each worker owns one
+** worker_counters block on its own cache line and is the only thread that
+** writes to it, so an update is a relaxed load and store with no locked
+** instruction and no cache line ping-pong. Readers sum the blocks up when a
+** snapshot is requested; the totals are only approximate while the pool is
+** running, since each counter is read separately.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+struct worker_metrics
+{
+    std::uint64_t tasks_executed = 0;
+    std::uint64_t steal_attempts = 0;   // victim queues probed
+    std::uint64_t steal_successes = 0;  // probes which got at least one task
+    std::uint64_t tasks_stolen = 0;     // tasks taken, surplus ones included
+    std::chrono::nanoseconds idle_time{0};  // spinning, yielding or parked
+    std::size_t queue_depth = 0;        // local queue, where others can see it
+
+    worker_metrics& operator+=(const worker_metrics& other)
+    {
+        tasks_executed += other.tasks_executed;
+        steal_attempts += other.steal_attempts;
+        steal_successes += other.steal_successes;
+        tasks_stolen += other.tasks_stolen;
+        idle_time += other.idle_time;
+        queue_depth += other.queue_depth;
+        return *this;
+    }
+};
+
+struct pool_metrics
+{
+    std::vector<worker_metrics> workers;
+    std::size_t pool_queue_depth = 0;   // tasks waiting in the shared queue
+
+    worker_metrics total() const
+    {
+        worker_metrics res;
+        for(const auto& worker : workers){
+            res += worker;
+        }
+        return res;
+    }
+};
+
+
+class alignas(64) worker_counters
+{
+    std::atomic<std::uint64_t> executed{0};
+    std::atomic<std::uint64_t> attempts{0};
+    std::atomic<std::uint64_t> successes{0};
+    std::atomic<std::uint64_t> stolen{0};
+    std::atomic<std::int64_t> idle_ns{0};
+
+    // owner only - there is no other writer, so no read-modify-write needed
+    template<typename Counter, typename Value>
+    static void add(Counter& counter, Value n) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+
+public:
+    void task_executed() noexcept { add(executed, 1); }
+
+    void steal_attempted(std::uint64_t tasks_taken) noexcept
+    {
+        add(attempts, 1);
+        if(tasks_taken){
+            add(successes, 1);
+            add(stolen, tasks_taken);
+        }
+    }
+
+    void idled(std::chrono::steady_clock::duration time) noexcept
+    {
+        add(idle_ns,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+    }
+
+    // any thread
+    worker_metrics read() const noexcept
+    {
+        worker_metrics res;
+        res.tasks_executed = executed.load(std::memory_order_relaxed);
+        res.steal_attempts = attempts.load(std::memory_order_relaxed);
+        res.steal_successes = successes.load(std::memory_order_relaxed);
+        res.tasks_stolen = stolen.load(std::memory_order_relaxed);
+        res.idle_time = std::chrono::nanoseconds(
+            idle_ns.load(std::memory_order_relaxed));
+        return res;
+    }
+};
+
+
+// Times one idle step of a worker and adds it to the worker's counters.
+class idle_timer
+{
+    worker_counters& counters;
+    const std::chrono::steady_clock::time_point start;
+
+public:
+    explicit idle_timer(worker_counters& counters_)
+        : counters(counters_), start(std::chrono::steady_clock::now())
+        { }
+
+    idle_timer(const idle_timer&) = delete;
+    idle_timer& operator=(const idle_timer&) = delete;
+
+    ~idle_timer()
+    {
+        counters.idled(std::chrono::steady_clock::now() - start);
+    }
+};
+
+
+#endif /* POOL_METRICS_HPP_ */
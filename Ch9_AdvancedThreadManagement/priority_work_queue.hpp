@@ -0,0 +1,147 @@
+#ifndef PRIORITY_WORK_QUEUE_HPP_
+#define PRIORITY_WORK_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include "threadsafe_queue.hpp"
+
+
+enum class task_priority
+{
+    critical,
+    normal,
+    background
+};
+
+
+// One FIFO lane per task_priority. try_pop() drains the higher lanes first,
+// but one in every starvation_limit picks looks at the background lane first,
+// so background work keeps trickling through while the pool is saturated.
+// Picks are only counted while background tasks are waiting.
+template<typename T>
+class priority_work_queue
+{
+    static constexpr std::size_t lane_count = 3;
+
+    threadsafe_queue<T> lanes[lane_count];
+    const unsigned starvation_limit;
+    std::atomic<unsigned> picks;
+    // counted up before a push and down after a pop, so they never underflow
+    std::atomic<std::size_t> queued;
+    std::atomic<std::size_t> background_queued;
+
+    threadsafe_queue<T>& lane(task_priority priority)
+    {
+        return lanes[static_cast<std::size_t>(priority)];
+    }
+
+    bool pop_from(task_priority priority, T& value)
+    {
+        if(!lane(priority).try_pop(value)){
+            return false;
+        }
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        if(priority == task_priority::background){
+            background_queued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void count_in(std::size_t count, task_priority priority)
+    {
+        queued.fetch_add(count, std::memory_order_relaxed);
+        if(priority == task_priority::background){
+            background_queued.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    bool background_waiting() const
+    {
+        return background_queued.load(std::memory_order_relaxed) != 0;
+    }
+
+public:
+    explicit priority_work_queue(unsigned starvation_limit_ = 32)
+        : starvation_limit(starvation_limit_ ? starvation_limit_ : 1)
+        , picks(0), queued(0), background_queued(0)
+        { }
+
+    priority_work_queue(const priority_work_queue&) = delete;
+    priority_work_queue& operator=(const priority_work_queue&) = delete;
+
+    void push(T new_value, task_priority priority = task_priority::normal)
+    {
+        count_in(1, priority);
+        lane(priority).push(std::move(new_value));
+    }
+
+    template<typename InputIt>
+    void push_range(InputIt first, InputIt last,
+                    task_priority priority = task_priority::normal)
+    {
+        count_in(std::distance(first, last), priority);
+        lane(priority).push_range(first, last);
+    }
+
+    // Call once per task pick, before looking at any higher lane. Returns
+    // true if it is the background lane's turn and it had a task. This one
+    // counts the picks of all callers together.
+    bool try_pop_starved(T& value)
+    {
+        if(!background_waiting()){
+            return false;
+        }
+        const unsigned pick = picks.fetch_add(1, std::memory_order_relaxed);
+        if(pick % starvation_limit != starvation_limit-1){
+            return false;
+        }
+        return pop_from(task_priority::background, value);
+    }
+
+    // The same with a counter owned by the caller, typically one per worker,
+    // so that polling the queue does not write to it at all.
+    bool try_pop_starved(T& value, unsigned& own_picks)
+    {
+        if(!background_waiting() ||
+           ++own_picks % starvation_limit != 0){
+            return false;
+        }
+        return pop_from(task_priority::background, value);
+    }
+
+    bool try_pop(T& value, task_priority priority)
+    {
+        return pop_from(priority, value);
+    }
+
+    bool try_pop(T& value)
+    {
+        return try_pop_starved(value) ||
+               pop_from(task_priority::critical, value) ||
+               pop_from(task_priority::normal, value) ||
+               pop_from(task_priority::background, value);
+    }
+
+    bool empty(task_priority priority)
+    {
+        return lane(priority).empty();
+    }
+
+    bool empty()
+    {
+        return lane(task_priority::critical).empty() &&
+               lane(task_priority::normal).empty() &&
+               lane(task_priority::background).empty();
+    }
+
+    // a snapshot, over all lanes
+    std::size_t size() const noexcept
+    {
+        return queued.load(std::memory_order_relaxed);
+    }
+};
+
+
+#endif /* PRIORITY_WORK_QUEUE_HPP_ */
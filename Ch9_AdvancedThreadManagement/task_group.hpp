@@ -0,0 +1,170 @@
+#ifndef TASK_GROUP_HPP_
+#define TASK_GROUP_HPP_
+
+/*
+** Structured fork-join on top of the work-stealing thread_pool.
+** spawn() posts a child task that only carries a pointer to the group, so
+** unlike submit() there is no std::future (and no shared state) per child.
+** wait() keeps the calling thread busy running pending pool tasks - its own
+** local ones first, then stolen ones - until every child has finished, and
+** only parks once there is nothing left to help with. wait() rethrows the
+** exception a child threw, or an aggregate_exception with all of them if
+** several did.
+** The group has to outlive its children, so the destructor waits as well.
+** A group constructed with a cancellation_token skips every child which has
+** not started by the time the token is cancelled, and so does a fail_fast
+** group once a child has failed; running children can poll is_cancelled()
+** to stop early. wait() still waits for the ones already running.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "work_stealing_thread_pool.hpp"
+#include "idle_policy.hpp"
+#include "cancellation.hpp"
+#include "aggregate_exception.hpp"
+
+
+enum class failure_policy
+{
+    run_all,    // a failing child does not affect its siblings
+    fail_fast   // the first failure cancels the children not yet started
+};
+
+
+class task_group
+{
+    thread_pool& pool;
+    const cancellation_token cancel_token;
+    const failure_policy on_failure;
+    // one count per running child plus one held by the group itself until
+    // wait() is called, so the count can only drop to zero inside wait()
+    std::atomic<std::size_t> pending;
+    std::atomic<bool> last_child_done;
+    std::atomic<bool> aborted;
+    std::atomic<bool> failed;
+    std::mutex error_mutex;
+    std::vector<std::exception_ptr> errors;
+    event_count all_done;
+
+    template<typename Function>
+    void run_child(Function& f) noexcept
+    {
+        try{
+            if(!is_cancelled()){
+                f();
+            }
+        }
+        catch(...){
+            {
+                std::lock_guard<std::mutex> lk(error_mutex);
+                errors.push_back(std::current_exception());
+            }
+            failed.store(true, std::memory_order_release);
+            if(on_failure == failure_policy::fail_fast){
+                cancel();
+            }
+        }
+        if(pending.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            all_done.notify_all();
+            // the group may be destroyed as soon as this is seen
+            last_child_done.store(true, std::memory_order_release);
+        }
+    }
+
+    void wait_for_children()
+    {
+        if(pending.fetch_sub(1, std::memory_order_acq_rel) != 1){
+            idle_backoff backoff{idle_policy()};
+            while(pending.load(std::memory_order_acquire) != 0){
+                if(pool.try_run_pending_task()){
+                    backoff.reset();
+                }
+                else{
+                    backoff.idle(all_done, [this]{
+                        return pending.load(std::memory_order_acquire) == 0; });
+                }
+            }
+            while(!last_child_done.load(std::memory_order_acquire)){
+                cpu_relax();
+            }
+            last_child_done.store(false, std::memory_order_relaxed);
+        }
+        pending.store(1, std::memory_order_relaxed);
+    }
+
+public:
+    explicit task_group(thread_pool& pool_,
+                        cancellation_token token = cancellation_token(),
+                        failure_policy on_failure_ = failure_policy::run_all)
+        : pool(pool_), cancel_token(std::move(token)), on_failure(on_failure_)
+        , pending(1), last_child_done(false), aborted(false), failed(false)
+        { }
+
+    task_group(thread_pool& pool_, failure_policy on_failure_)
+        : task_group(pool_, cancellation_token(), on_failure_)
+        { }
+
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+
+    ~task_group()
+    {
+        wait_for_children();
+    }
+
+    // may also be called from a running child of this group
+    template<typename Function>
+    void spawn(Function f)
+    {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        try{
+            pool.post([this, f=std::move(f)]() mutable { run_child(f); });
+        }
+        catch(...){
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+    }
+
+    const cancellation_token& token() const noexcept
+    {
+        return cancel_token;
+    }
+
+    bool is_cancelled() const noexcept
+    {
+        return aborted.load(std::memory_order_acquire) ||
+               cancel_token.is_cancelled();
+    }
+
+    // skips every child which has not started yet, until wait() returns
+    void cancel() noexcept
+    {
+        aborted.store(true, std::memory_order_release);
+    }
+
+    // After wait() returns the group can be reused for another round. It
+    // returns normally if children were skipped because of cancellation.
+    void wait()
+    {
+        wait_for_children();
+        aborted.store(false, std::memory_order_relaxed);
+        if(failed.load(std::memory_order_acquire)){
+            std::vector<std::exception_ptr> caught;
+            {
+                std::lock_guard<std::mutex> lk(error_mutex);
+                caught.swap(errors);
+            }
+            failed.store(false, std::memory_order_relaxed);
+            rethrow_exceptions(std::move(caught));
+        }
+    }
+};
+
+
+#endif /* TASK_GROUP_HPP_ */
@@ -0,0 +1,109 @@
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <cassert>
+#include "coroutine_task.hpp"
+
+
+task<int> answer()
+{
+    co_return 42;
+}
+
+task<std::thread::id> id_on_pool(thread_pool& pool)
+{
+    co_await pool.schedule();
+    co_return std::this_thread::get_id();
+}
+
+void test_task_is_lazy_and_awaitable()
+{
+    bool started = false;
+    // state goes in as a parameter: a lambda's captures would not outlive
+    // the temporary closure
+    auto t = [](bool& started) -> task<int> {
+        started = true;
+        co_return co_await answer() + 1;
+    }(started);
+    assert(!started);
+    assert(sync_wait(std::move(t)) == 43);
+    assert(started);
+}
+
+void test_schedule_resumes_on_a_worker()
+{
+    thread_pool pool(2);
+    assert(sync_wait(id_on_pool(pool)) != std::this_thread::get_id());
+}
+
+void test_continuation_runs_on_the_pool()
+{
+    thread_pool pool(2);
+    auto outer = [](thread_pool& pool) -> task<bool> {
+        const std::thread::id inner = co_await id_on_pool(pool);
+        // resumed directly by the finished task, on the same worker
+        co_return inner == std::this_thread::get_id();
+    };
+    assert(sync_wait(outer(pool)));
+}
+
+void test_exceptions_propagate()
+{
+    thread_pool pool(2);
+    auto failing = [](thread_pool& pool) -> task<void> {
+        co_await pool.schedule();
+        throw std::runtime_error("boom");
+    };
+    try{
+        sync_wait(failing(pool));
+        assert(false);
+    }
+    catch(const std::runtime_error&) { }
+}
+
+task<long> fib(thread_pool& pool, int n)
+{
+    if(n < 2){
+        co_return n;
+    }
+    co_await pool.schedule();
+    std::vector<task<long>> parts;
+    parts.push_back(fib(pool, n-1));
+    parts.push_back(fib(pool, n-2));
+    const std::vector<long> results = co_await when_all(std::move(parts));
+    co_return results[0] + results[1];
+}
+
+void test_when_all_runs_tasks_in_parallel()
+{
+    thread_pool pool(4);
+    assert(sync_wait(fib(pool, 20)) == 6765);
+
+    std::atomic<int> count(0);
+    std::vector<task<void>> jobs;
+    for(int i=0; i<100; ++i){
+        jobs.push_back([](thread_pool& pool, std::atomic<int>& count) -> task<void> {
+            co_await pool.schedule();
+            ++count;
+        }(pool, count));
+    }
+    sync_wait(when_all(std::move(jobs)));
+    assert(count == 100);
+
+    auto [a, b] = sync_wait(when_all(answer(), fib(pool, 10)));
+    assert(a == 42 && b == 55);
+
+    assert(sync_wait(when_all(std::vector<task<int>>())).empty());
+}
+
+
+int main()
+{
+    test_task_is_lazy_and_awaitable();
+    test_schedule_resumes_on_a_worker();
+    test_continuation_runs_on_the_pool();
+    test_exceptions_propagate();
+    test_when_all_runs_tasks_in_parallel();
+}
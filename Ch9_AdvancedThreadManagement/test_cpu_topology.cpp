@@ -0,0 +1,33 @@
+#include <vector>
+#include <cassert>
+#include "cpu_topology.hpp"
+
+
+void test_parse_cpu_list()
+{
+    assert((parse_cpu_list("0-3,8,10-11") ==
+            std::vector<unsigned>{0,1,2,3,8,10,11}));
+    assert((parse_cpu_list("5\n") == std::vector<unsigned>{5}));
+    assert(parse_cpu_list("").empty());
+}
+
+void test_detected_topology_is_usable()
+{
+    const cpu_topology topology;
+    assert(topology.cpu_count() >= 1);
+    assert(topology.node_count() >= 1);
+    for(unsigned worker=0; worker<2*topology.cpu_count(); ++worker){
+        assert(topology.node_for_worker(worker) < topology.node_count());
+    }
+
+    std::thread t([]{});
+    assert(cpu_topology::pin(t, topology.cpu_for_worker(0)));
+    t.join();
+}
+
+
+int main()
+{
+    test_parse_cpu_list();
+    test_detected_topology_is_usable();
+}
@@ -0,0 +1,96 @@
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <new>
+#include <cassert>
+#include "function_wrapper.hpp"
+
+
+// The scalar, array and sized forms are all replaced, so that whatever any
+// operator new hands out goes back through a matching operator delete.
+namespace
+{
+std::atomic<unsigned> allocation_count(0);
+
+void* counted_allocation(std::size_t size)
+{
+    ++allocation_count;
+    if(void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+}
+
+void* operator new(std::size_t size) { return counted_allocation(size); }
+void* operator new[](std::size_t size) { return counted_allocation(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+
+void test_small_callables_are_stored_inline()
+{
+    static_assert(sizeof(function_wrapper) == 64, "one cache line");
+    int calls{0};
+    const unsigned before = allocation_count;
+    {
+        function_wrapper f([&calls]{ ++calls; });
+        function_wrapper g(std::move(f));
+        assert(!f && g);
+        g();
+        function_wrapper h;
+        h = std::move(g);
+        h();
+    }
+    assert(allocation_count == before);
+    assert(calls == 2);
+}
+
+void test_large_callables_fall_back_to_the_heap()
+{
+    std::array<char,128> payload{};
+    payload[127] = 'x';
+    char seen{0};
+    const unsigned before = allocation_count;
+    {
+        function_wrapper f([payload, &seen]{ seen = payload[127]; });
+        function_wrapper g(std::move(f));
+        g();
+    }
+    assert(allocation_count == before + 1);
+    assert(seen == 'x');
+}
+
+void test_captured_state_is_destroyed_once()
+{
+    auto token = std::make_shared<int>(42);
+    {
+        function_wrapper f([token]{ });
+        function_wrapper g(std::move(f));
+        function_wrapper h;
+        h = std::move(g);
+        assert(token.use_count() == 2);
+    }
+    assert(token.use_count() == 1);
+}
+
+void test_wraps_packaged_task()
+{
+    std::packaged_task<int()> task([]{ return 7; });
+    std::future<int> res = task.get_future();
+    function_wrapper f(std::move(task));
+    f();
+    assert(res.get() == 7);
+}
+
+
+int main()
+{
+    test_small_callables_are_stored_inline();
+    test_large_callables_fall_back_to_the_heap();
+    test_captured_state_is_destroyed_once();
+    test_wraps_packaged_task();
+}
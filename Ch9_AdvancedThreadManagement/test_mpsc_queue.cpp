@@ -0,0 +1,84 @@
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cassert>
+#include "mpsc_queue.hpp"
+
+
+void test_fifo_order()
+{
+    mpsc_queue<int> q;
+    int value{-1};
+    assert(q.empty() && !q.try_pop(value));
+    for(int i=0; i<10; ++i){
+        q.push(i);
+    }
+    assert(q.size() == 10 && !q.empty());
+    for(int i=0; i<10; ++i){
+        assert(q.try_pop(value) && value == i);
+    }
+    assert(q.empty() && !q.try_pop(value));
+}
+
+void test_producers_keep_their_own_order()
+{
+    const int producer_count = 4;
+    const int per_producer = 50000;
+    mpsc_queue<int> q;
+    std::vector<std::thread> producers;
+    for(int p=0; p<producer_count; ++p){
+        producers.emplace_back([&q, p]{
+            for(int i=0; i<per_producer; ++i){
+                q.push(p*per_producer + i);
+            }
+        });
+    }
+    // two consumers, only one of which can be popping at any time; each
+    // sees a subsequence of the queue's order
+    std::atomic<int> popped(0);
+    std::atomic<bool> order_ok(true);
+    auto consume = [&]{
+        std::vector<int> last_seen(producer_count, -1);
+        int value;
+        while(popped < producer_count*per_producer){
+            if(q.try_pop(value)){
+                ++popped;
+                const int p = value / per_producer;
+                if(value <= last_seen[p]){
+                    order_ok = false;
+                }
+                last_seen[p] = value;
+            }
+        }
+    };
+    std::thread second_consumer(consume);
+    consume();
+    second_consumer.join();
+    for(auto& t : producers){
+        t.join();
+    }
+    assert(order_ok);
+    assert(q.empty() && q.size() == 0);
+}
+
+void test_leftovers_are_destroyed()
+{
+    auto counter = std::make_shared<int>(0);
+    {
+        mpsc_queue<std::shared_ptr<int>> q;
+        for(int i=0; i<5; ++i){
+            q.push(counter);
+        }
+        assert(counter.use_count() == 6);
+    }
+    assert(counter.use_count() == 1);
+}
+
+
+int main()
+{
+    test_fifo_order();
+    test_producers_keep_their_own_order();
+    test_leftovers_are_destroyed();
+}
@@ -0,0 +1,88 @@
+#include <atomic>
+#include <future>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include <cassert>
+#include "parallel_accumlate_waitable_pool.hpp"
+
+
+void test_accumulates_on_the_default_executor()
+{
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 1);
+    // the workers are started once and reused by every call
+    for(int i=0; i<100; ++i){
+        assert(parallel_accumulate(values.begin(), values.end(), 0) == 500500);
+    }
+    assert(&default_executor() == &default_executor());
+    assert(parallel_accumulate(values.begin(), values.begin(), 7) == 7);
+}
+
+void test_accumulates_on_an_explicit_pool()
+{
+    thread_pool pool(2);
+    std::vector<long> values(10000, 2);
+    assert(parallel_accumulate(pool, values.begin(), values.end(), 1L) == 20001);
+}
+
+void test_nested_in_a_task_of_another_pool()
+{
+    thread_pool pool(1);
+    std::vector<int> values(1000, 1);
+    // the only worker of pool blocks in here, so the blocks have to run on
+    // the default executor rather than land in pool's local queue
+    auto res = pool.submit([&values]{
+        return parallel_accumulate(default_executor(),
+                                   values.begin(), values.end(), 0); });
+    assert(res.get() == 1000);
+}
+
+// a value which refuses to be added to a negative one
+struct checked_value
+{
+    long value = 0;
+
+    checked_value operator+(const checked_value& other) const
+    {
+        if(other.value < 0)
+            throw std::domain_error("negative value");
+        return checked_value{value + other.value};
+    }
+    checked_value& operator+=(const checked_value& other)
+    {
+        value += other.value;
+        return *this;
+    }
+};
+
+void test_block_failures_are_reported_together()
+{
+    thread_pool pool(2);
+    std::vector<checked_value> values(1000, checked_value{1});
+    values[10].value = -1;
+    values[500].value = -1;
+    values[990].value = -1;
+    try{
+        parallel_accumulate(pool, values.begin(), values.end(), checked_value{});
+        assert(false);
+    }
+    catch(const std::domain_error&){
+        // the other failing blocks were skipped
+    }
+    catch(const aggregate_exception& e){
+        assert(e.size() >= 2 && e.size() <= 3);
+    }
+    values[10].value = values[500].value = values[990].value = 1;
+    assert(parallel_accumulate(pool, values.begin(), values.end(),
+                               checked_value{}).value == 1000);
+}
+
+
+int main()
+{
+    test_accumulates_on_the_default_executor();
+    test_accumulates_on_an_explicit_pool();
+    test_nested_in_a_task_of_another_pool();
+    test_block_failures_are_reported_together();
+}
@@ -0,0 +1,23 @@
+#include <list>
+#include <random>
+#include <cassert>
+#include "parallel_quicksort_thread_pool.hpp"
+
+
+int main()
+{
+    std::default_random_engine re(42);
+    std::uniform_int_distribution<> ud(0, 10000);
+    std::list<int> input;
+    for(int i=0; i<20000; ++i){
+        input.push_back(ud(re));
+    }
+    std::list<int> expected(input);
+    expected.sort();
+
+    assert(parallel_quicksort(input) == expected);
+    assert(parallel_quicksort(std::list<int>()).empty());
+
+    thread_pool pool(2);
+    assert(parallel_quicksort(pool, input) == expected);
+}
@@ -0,0 +1,124 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <vector>
+#include <thread>
+#include <cassert>
+#include "simple_thread_pool.hpp"
+
+
+void test_runs_submitted_tasks()
+{
+    std::atomic<int> counter(0);
+    {
+        thread_pool pool(4);
+        for(int i=0; i<1000; ++i){
+            pool.submit([&counter]{ ++counter; });
+        }
+        while(counter != 1000){
+            std::this_thread::yield();
+        }
+    }
+    assert(counter == 1000);
+}
+
+void test_parked_workers_wake_up_for_new_work()
+{
+    idle_policy idle;
+    idle.spin_rounds = 1;
+    idle.yield_rounds = 1;
+    thread_pool pool(2, idle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    std::atomic<bool> ran(false);
+    pool.submit([&ran]{ ran = true; });
+    while(!ran){
+        std::this_thread::yield();
+    }
+}
+
+
+void test_bulk_submission()
+{
+    thread_pool pool(4);
+    std::atomic<int> counter(0);
+    std::vector<std::function<void()>> jobs(100, [&counter]{ ++counter; });
+    pool.submit_bulk(jobs.begin(), jobs.end());
+    pool.submit_n(100, [&counter](std::size_t){ ++counter; }).get();
+    while(counter != 200){
+        std::this_thread::yield();
+    }
+}
+
+void test_metrics_count_executed_tasks()
+{
+    thread_pool pool(2);
+    pool.submit_n(100, [](std::size_t){ }).get();
+    // the counter is bumped just after the task returns
+    pool_metrics metrics = pool.metrics();
+    while(metrics.total().tasks_executed < 100){
+        std::this_thread::yield();
+        metrics = pool.metrics();
+    }
+    assert(metrics.workers.size() == 2);
+    assert(metrics.total().tasks_executed == 100);
+    assert(metrics.pool_queue_depth == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    assert(pool.metrics().total().idle_time.count() > 0);
+}
+
+void test_shutdown_drains_queued_and_spawned_tasks()
+{
+    thread_pool pool(2);
+    std::atomic<int> ran(0);
+    for(int i=0; i<50; ++i){
+        pool.submit([&pool, &ran]{
+            ++ran;
+            pool.submit([&ran]{ ++ran; });
+        });
+    }
+    pool.shutdown();
+    assert(ran == 100);
+    pool.submit([&ran]{ ++ran; });
+    pool.shutdown();
+    assert(ran == 100);
+}
+
+void test_shutdown_discards_pending_tasks()
+{
+    thread_pool pool(1);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::promise<void> running;
+    pool.submit([&running, go]{
+        running.set_value();
+        go.wait();
+    });
+    running.get_future().wait();
+    std::atomic<int> ran(0);
+    for(int i=0; i<10; ++i){
+        pool.submit([&ran]{ ++ran; });
+    }
+
+    std::thread stopper([&pool]{
+        pool.shutdown(drain_policy{drain_mode::discard});
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    release.set_value();
+    stopper.join();
+    // some of them only ran if shutdown() had not begun by the time the
+    // blocker finished; the rest are gone
+    assert(pool.metrics().pool_queue_depth == 0);
+    assert(ran <= 10);
+}
+
+int main()
+{
+    test_runs_submitted_tasks();
+    test_parked_workers_wake_up_for_new_work();
+    test_bulk_submission();
+    test_metrics_count_executed_tasks();
+    test_shutdown_drains_queued_and_spawned_tasks();
+    test_shutdown_discards_pending_tasks();
+}
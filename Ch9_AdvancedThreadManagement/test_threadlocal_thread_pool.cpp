@@ -0,0 +1,107 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include "threadlocal_thread_pool.hpp"
+
+
+void test_nested_submit_runs_on_the_local_queue()
+{
+    thread_pool pool(4);
+    std::atomic<int> counter(0);
+    auto outer = pool.submit([&pool, &counter]{
+        std::vector<std::future<void>> inner;
+        for(int i=0; i<100; ++i){
+            inner.push_back(pool.submit([&counter]{ ++counter; }));
+        }
+        for(auto& f : inner){
+            while(f.wait_for(std::chrono::seconds(0)) !=
+                    std::future_status::ready){
+                pool.run_pending_task();
+            }
+        }
+    });
+    outer.get();
+    assert(counter == 100);
+}
+
+void test_parked_workers_wake_up_for_new_work()
+{
+    idle_policy idle;
+    idle.spin_rounds = 1;
+    idle.yield_rounds = 1;
+    thread_pool pool(2, idle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(pool.submit([]{ return 42; }).get() == 42);
+}
+
+template<typename Future>
+bool holds_broken_promise(Future& res)
+{
+    try{
+        res.get();
+    }
+    catch(const std::future_error& e){
+        return e.code() == std::future_errc::broken_promise;
+    }
+    return false;
+}
+
+void test_shutdown_drains_queued_and_spawned_tasks()
+{
+    thread_pool pool(2);
+    std::atomic<int> ran(0);
+    for(int i=0; i<50; ++i){
+        pool.submit([&pool, &ran]{
+            ++ran;
+            pool.submit([&ran]{ ++ran; });
+        });
+    }
+    pool.shutdown();
+    assert(ran == 100);
+    auto late = pool.submit([]{ return 1; });
+    assert(holds_broken_promise(late));
+    pool.shutdown();
+}
+
+void test_shutdown_deadline_bounds_the_drain()
+{
+    thread_pool pool(1);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::promise<void> running;
+    auto blocker = pool.submit([&running, go]{
+        running.set_value();
+        go.wait();
+    });
+    running.get_future().wait();
+    std::vector<std::future<int>> results;
+    for(int i=0; i<10; ++i){
+        results.push_back(pool.submit([i]{ return i; }));
+    }
+
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(5);
+    std::thread stopper([&pool, deadline]{
+        pool.shutdown(drain_policy{drain_mode::drain_with_deadline, deadline});
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    release.set_value();
+    stopper.join();
+    blocker.get();
+    // the blocker only finished after the deadline
+    for(auto& r : results){
+        assert(holds_broken_promise(r));
+    }
+}
+
+
+int main()
+{
+    test_nested_submit_runs_on_the_local_queue();
+    test_parked_workers_wake_up_for_new_work();
+    test_shutdown_drains_queued_and_spawned_tasks();
+    test_shutdown_deadline_bounds_the_drain();
+}
@@ -0,0 +1,82 @@
+#include <cassert>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include "threadsafe_queue.hpp"
+
+
+void test_try_pop_bulk_takes_at_most_max_n()
+{
+    threadsafe_queue<std::string> q;
+    std::vector<std::string> out;
+    assert(q.try_pop_bulk(std::back_inserter(out), 8) == 0);
+    for(int i=0; i<10; ++i){
+        q.push(std::to_string(i));
+    }
+    assert(q.try_pop_bulk(std::back_inserter(out), 0) == 0);
+    assert(q.try_pop_bulk(std::back_inserter(out), 4) == 4);
+    assert(q.try_pop_bulk(std::back_inserter(out), 4) == 4);
+    std::string value;
+    assert(q.try_pop(value) && value == "8");
+    q.push("10");
+    assert(q.try_pop_bulk(std::back_inserter(out), 4) == 2);
+    assert(q.empty());
+    const std::vector<std::string> expected{"0","1","2","3","4","5","6","7","9","10"};
+    assert(out == expected);
+}
+
+void test_drain_takes_everything()
+{
+    threadsafe_queue<int> q;
+    // long enough to overflow the stack if the run were freed recursively
+    const int count = 1000000;
+    for(int i=0; i<count; ++i){
+        q.push(i);
+    }
+    std::vector<int> out{-1};
+    assert(q.drain(out) == count);
+    assert(out.size() == count + 1 && out.front() == -1 && out.back() == count - 1);
+    assert(q.empty() && q.drain(out) == 0);
+    q.push(7);
+    int value;
+    assert(q.try_pop(value) && value == 7);
+}
+
+void test_destroying_a_long_queue()
+{
+    // as above, for the nodes still queued when the queue goes
+    threadsafe_queue<int> q;
+    for(int i=0; i<1000000; ++i){
+        q.push(i);
+    }
+}
+
+void test_wait_and_pop_bulk_waits_for_the_first_value()
+{
+    threadsafe_queue<int> q;
+    const int count = 100000;
+    std::thread producer([&q]{
+        for(int i=0; i<count; ++i){
+            q.push(i);
+        }
+    });
+    std::vector<int> out;
+    while(out.size() != count){
+        assert(q.wait_and_pop_bulk(std::back_inserter(out), 64) >= 1);
+    }
+    producer.join();
+    for(int i=0; i<count; ++i){
+        assert(out[i] == i);
+    }
+    assert(q.empty());
+}
+
+
+int main()
+{
+    test_try_pop_bulk_takes_at_most_max_n();
+    test_drain_takes_everything();
+    test_destroying_a_long_queue();
+    test_wait_and_pop_bulk_waits_for_the_first_value();
+}
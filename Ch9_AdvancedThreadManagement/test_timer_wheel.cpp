@@ -0,0 +1,109 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cassert>
+#include "timer_wheel.hpp"
+
+
+using clock_type = timer_wheel<int>::clock;
+
+void test_expires_nothing_early_and_everything_on_time()
+{
+    const clock_type::time_point start;
+    const std::chrono::microseconds tick(1);
+    timer_wheel<int> wheel(tick, start);
+
+    // deadlines spread over every level, and past the top one's range
+    std::default_random_engine re(7);
+    std::vector<std::chrono::microseconds> deadlines;
+    for(int i=0; i<5000; ++i){
+        const int magnitude = i % 9;
+        std::uniform_int_distribution<long> ud(1, 1L << (3*magnitude+2));
+        deadlines.push_back(std::chrono::microseconds(ud(re)));
+    }
+    deadlines.push_back(std::chrono::seconds(100));
+    for(int i=0; i<static_cast<int>(deadlines.size()); ++i){
+        assert(wheel.schedule(start + deadlines[i], i));
+    }
+    assert(wheel.size() == deadlines.size());
+
+    std::vector<bool> fired(deadlines.size(), false);
+    clock_type::time_point now = start;
+    for(int step=0; !wheel.empty(); ++step){
+        assert(wheel.next_event() > now);
+        // mostly step to the next event, sometimes jump well past it
+        const bool jump = step % 3 == 0;
+        now = wheel.next_event() + (jump ? std::chrono::microseconds(300)
+                                         : std::chrono::microseconds(0));
+        wheel.advance(now, [&](int index){
+            assert(!fired[index]);
+            assert(start + deadlines[index] <= now);
+            if(!jump){
+                assert(start + deadlines[index] == now);
+            }
+            fired[index] = true;
+        });
+    }
+    for(bool f : fired){
+        assert(f);
+    }
+    assert(wheel.next_event() == clock_type::time_point::max());
+}
+
+void test_exact_expiry_when_stepping_tick_by_tick()
+{
+    const clock_type::time_point start;
+    const std::chrono::milliseconds tick(1);
+    timer_wheel<int> wheel(tick, start);
+    for(int i=1; i<=300; ++i){
+        int deadline = i*17;
+        assert(wheel.schedule(start + std::chrono::milliseconds(deadline), deadline));
+    }
+    for(int t=1; t<=300*17; ++t){
+        wheel.advance(start + std::chrono::milliseconds(t), [t](int deadline){
+            assert(deadline == t);
+        });
+    }
+    assert(wheel.empty());
+}
+
+void test_due_values_are_handed_back()
+{
+    const clock_type::time_point start;
+    timer_wheel<int> wheel(std::chrono::milliseconds(1), start);
+    wheel.advance(start + std::chrono::milliseconds(10), [](int){ assert(false); });
+    int value = 42;
+    assert(!wheel.schedule(start + std::chrono::milliseconds(10), value));
+    assert(!wheel.schedule(start, value));
+    assert(value == 42 && wheel.empty());
+    // deadlines are rounded up to a whole tick
+    assert(wheel.schedule(start + std::chrono::microseconds(10500), value));
+    int fired = 0;
+    wheel.advance(start + std::chrono::milliseconds(10), [&fired](int){ ++fired; });
+    assert(fired == 0);
+    wheel.advance(start + std::chrono::milliseconds(11), [&fired](int){ ++fired; });
+    assert(fired == 1);
+}
+
+
+void test_deadlines_at_the_ends_of_time()
+{
+    const clock_type::time_point start(std::chrono::hours(1));
+    timer_wheel<int> wheel(std::chrono::milliseconds(1), start);
+    int value = 1;
+    assert(!wheel.schedule(clock_type::time_point::min(), value));
+    assert(wheel.schedule(clock_type::time_point::max(), value));
+    assert(wheel.size() == 1);
+    // parked in the top level, so nothing fires within a day
+    const std::size_t fired = wheel.advance(start + std::chrono::hours(24),
+                                            [](int){ });
+    assert(fired == 0 && wheel.size() == 1);
+}
+
+int main()
+{
+    test_expires_nothing_early_and_everything_on_time();
+    test_exact_expiry_when_stepping_tick_by_tick();
+    test_due_values_are_handed_back();
+    test_deadlines_at_the_ends_of_time();
+}
@@ -0,0 +1,192 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include "waitable_thread_pool.hpp"
+
+
+void test_submit_returns_results()
+{
+    thread_pool pool(4);
+    std::vector<std::future<int>> results;
+    for(int i=0; i<1000; ++i){
+        results.push_back(pool.submit([i]{ return i+1; }));
+    }
+    for(int i=0; i<1000; ++i){
+        assert(results[i].get() == i+1);
+    }
+}
+
+void test_parked_workers_wake_up_for_new_work()
+{
+    idle_policy idle;
+    idle.spin_rounds = 1;
+    idle.yield_rounds = 1;
+    thread_pool pool(2, idle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(pool.submit([]{ return 42; }).get() == 42);
+}
+
+
+void test_submit_bulk_returns_a_future_per_task()
+{
+    thread_pool pool(4);
+    std::vector<std::function<int()>> jobs;
+    for(int i=0; i<100; ++i){
+        jobs.push_back([i]{ return i*i; });
+    }
+    auto results = pool.submit_bulk(jobs.begin(), jobs.end());
+    assert(results.size() == 100);
+    for(int i=0; i<100; ++i){
+        assert(results[i].get() == i*i);
+    }
+}
+
+void test_submit_n_completes_once_all_tasks_ran()
+{
+    thread_pool pool(4);
+    std::vector<std::atomic<int>> hits(500);
+    pool.submit_n(hits.size(), [&hits](std::size_t i){ ++hits[i]; }).get();
+    for(auto& h : hits){
+        assert(h == 1);
+    }
+
+    auto failing = pool.submit_n(10, [](std::size_t i){
+        if(i == 3) throw std::runtime_error("task 3");
+    });
+    bool thrown = false;
+    try{ failing.get(); }
+    catch(const std::runtime_error&){ thrown = true; }
+    assert(thrown);
+
+    pool.submit_n(0, [](std::size_t){}).get();
+}
+
+
+void test_higher_priority_lanes_run_first()
+{
+    thread_pool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened(gate.get_future());
+    pool.submit([opened]{ opened.wait(); });
+
+    std::mutex m;
+    std::vector<char> order;
+    auto record = [&m, &order](char c){
+        return [&m, &order, c]{
+            std::lock_guard<std::mutex> lk(m);
+            order.push_back(c);
+        };
+    };
+    pool.submit(record('b'), task_priority::background);
+    pool.submit(record('n'), task_priority::normal);
+    auto last = pool.submit(record('c'), task_priority::critical);
+    gate.set_value();
+    last.get();
+    pool.submit([]{}, task_priority::background).get();
+
+    assert((order == std::vector<char>{'c','n','b'}));
+}
+
+void test_background_lane_is_not_starved()
+{
+    thread_pool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened(gate.get_future());
+    pool.submit([opened]{ opened.wait(); });
+
+    std::atomic<int> critical_done(0);
+    int critical_done_before_background{-1};
+    auto background = pool.submit([&]{
+        critical_done_before_background = critical_done;
+    }, task_priority::background);
+    std::vector<std::future<void>> critical;
+    for(int i=0; i<200; ++i){
+        critical.push_back(pool.submit([&critical_done]{ ++critical_done; },
+                                       task_priority::critical));
+    }
+    gate.set_value();
+    background.get();
+    assert(critical_done_before_background < 200);
+    for(auto& f : critical){
+        f.get();
+    }
+}
+
+template<typename Future>
+bool holds_broken_promise(Future& res)
+{
+    try{
+        res.get();
+    }
+    catch(const std::future_error& e){
+        return e.code() == std::future_errc::broken_promise;
+    }
+    return false;
+}
+
+void test_shutdown_drains_queued_and_spawned_tasks()
+{
+    thread_pool pool(2);
+    std::atomic<int> ran(0);
+    for(int i=0; i<50; ++i){
+        pool.submit([&pool, &ran]{
+            ++ran;
+            pool.submit([&ran]{ ++ran; });
+        });
+    }
+    pool.shutdown();
+    assert(ran == 100);
+    auto late = pool.submit([]{ return 1; });
+    assert(holds_broken_promise(late));
+    pool.shutdown();
+}
+
+void test_shutdown_deadline_bounds_the_drain()
+{
+    thread_pool pool(1);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::promise<void> running;
+    auto blocker = pool.submit([&running, go]{
+        running.set_value();
+        go.wait();
+    });
+    running.get_future().wait();
+    std::vector<std::future<int>> results;
+    for(int i=0; i<10; ++i){
+        results.push_back(pool.submit([i]{ return i; }));
+    }
+
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(5);
+    std::thread stopper([&pool, deadline]{
+        pool.shutdown(drain_policy{drain_mode::drain_with_deadline, deadline});
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    release.set_value();
+    stopper.join();
+    blocker.get();
+    // the blocker only finished after the deadline
+    for(auto& r : results){
+        assert(holds_broken_promise(r));
+    }
+}
+
+
+int main()
+{
+    test_submit_returns_results();
+    test_parked_workers_wake_up_for_new_work();
+    test_submit_bulk_returns_a_future_per_task();
+    test_submit_n_completes_once_all_tasks_ran();
+    test_higher_priority_lanes_run_first();
+    test_background_lane_is_not_starved();
+    test_shutdown_drains_queued_and_spawned_tasks();
+    test_shutdown_deadline_bounds_the_drain();
+}
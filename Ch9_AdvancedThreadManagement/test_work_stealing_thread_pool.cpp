@@ -0,0 +1,734 @@
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <numeric>
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include "work_stealing_thread_pool.hpp"
+#include "task_group.hpp"
+
+
+void test_submit_from_outside_the_pool()
+{
+    thread_pool pool(4);
+    std::vector<pool_future<int>> results;
+    for(int i=0; i<1000; ++i){
+        results.push_back(pool.submit([i]{ return i*2; }));
+    }
+    for(int i=0; i<1000; ++i){
+        assert(results[i].get() == i*2);
+    }
+}
+
+void test_nested_submit_runs_from_local_queues()
+{
+    thread_pool pool(4);
+    std::atomic<int> counter(0);
+
+    auto outer = pool.submit([&pool, &counter]{
+        std::vector<pool_future<void>> inner;
+        for(int i=0; i<100; ++i){
+            inner.push_back(pool.submit([&counter]{ ++counter; }));
+        }
+        for(auto& f : inner){
+            while(f.wait_for(std::chrono::seconds(0)) !=
+                    std::future_status::ready){
+                pool.run_pending_task();
+            }
+        }
+    });
+    outer.get();
+    assert(counter == 100);
+}
+
+void test_local_queue_overflow_still_runs()
+{
+    thread_pool pool(2);
+    std::atomic<int> counter(0);
+    // far more than a worker's local queue holds; the rest go to the pool's
+    pool.submit_std([&pool, &counter]{
+        std::vector<pool_future<void>> inner;
+        for(int i=0; i<5000; ++i){
+            inner.push_back(pool.submit([&counter]{ ++counter; }));
+        }
+        for(auto& f : inner){
+            f.get();
+        }
+    }).get();
+    assert(counter == 5000);
+}
+
+void test_parked_workers_wake_up_for_new_work()
+{
+    idle_policy idle;
+    idle.spin_rounds = 1;
+    idle.yield_rounds = 1;
+    thread_pool pool(2, idle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(pool.submit([]{ return 42; }).get() == 42);
+}
+
+void test_idle_workers_steal_a_busy_workers_tasks()
+{
+    thread_pool pool(4);
+    std::atomic<int> counter(0);
+
+    // the submitting task never runs its own queue, so everything it
+    // spawns has to be stolen - by the workers, as waiting on a std::future
+    // does not help
+    pool.submit_std([&pool, &counter]{
+        for(int i=0; i<1000; ++i){
+            pool.submit([&counter]{ ++counter; });
+        }
+        while(counter != 1000){
+            std::this_thread::yield();
+        }
+    }).get();
+
+    const steal_statistics stats = pool.steal_stats();
+    assert(stats.tasks_stolen >= 1000);
+    assert(stats.successes >= 1 && stats.successes <= stats.attempts);
+}
+
+
+void test_submit_bulk_returns_a_future_per_task()
+{
+    thread_pool pool(4);
+    std::vector<std::function<int()>> jobs;
+    for(int i=0; i<100; ++i){
+        jobs.push_back([i]{ return i*i; });
+    }
+    auto results = pool.submit_bulk(jobs.begin(), jobs.end());
+    assert(results.size() == 100);
+    for(int i=0; i<100; ++i){
+        assert(results[i].get() == i*i);
+    }
+}
+
+void test_submit_n_completes_once_all_tasks_ran()
+{
+    thread_pool pool(4);
+    std::vector<std::atomic<int>> hits(500);
+    pool.submit_n(hits.size(), [&hits](std::size_t i){ ++hits[i]; }).get();
+    for(auto& h : hits){
+        assert(h == 1);
+    }
+
+    auto failing = pool.submit_n(10, [](std::size_t i){
+        if(i == 3) throw std::runtime_error("task 3");
+    });
+    bool thrown = false;
+    try{ failing.get(); }
+    catch(const std::runtime_error&){ thrown = true; }
+    assert(thrown);
+
+    pool.submit_n(0, [](std::size_t){}).get();
+}
+
+
+long fib(thread_pool& pool, int n)
+{
+    if(n < 2){
+        return n;
+    }
+    long lhs{0};
+    task_group children(pool);
+    children.spawn([&pool, &lhs, n]{ lhs = fib(pool, n-1); });
+    const long rhs = fib(pool, n-2);
+    children.wait();
+    return lhs + rhs;
+}
+
+void test_task_group_fork_join()
+{
+    thread_pool pool(4);
+    assert(pool.submit([&pool]{ return fib(pool, 20); }).get() == 6765);
+    // waiting from outside the pool helps as well
+    assert(fib(pool, 18) == 2584);
+}
+
+void test_task_group_rethrows_child_exception()
+{
+    thread_pool pool(4);
+    std::atomic<int> finished(0);
+    task_group group(pool);
+    for(int i=0; i<10; ++i){
+        group.spawn([i, &finished]{
+            ++finished;
+            if(i == 5) throw std::runtime_error("child 5");
+        });
+    }
+    bool thrown = false;
+    try{ group.wait(); }
+    catch(const std::runtime_error&){ thrown = true; }
+    assert(thrown && finished == 10);
+
+    // reusable after wait()
+    group.spawn([&finished]{ ++finished; });
+    group.wait();
+    assert(finished == 11);
+}
+
+void test_task_group_aggregates_child_exceptions()
+{
+    thread_pool pool(2);
+    task_group group(pool);
+    for(int i=0; i<3; ++i){
+        group.spawn([i]{ throw std::runtime_error("child " + std::to_string(i)); });
+    }
+    group.spawn([]{ });
+    try{
+        group.wait();
+        assert(false);
+    }
+    catch(const aggregate_exception& e){
+        assert(e.size() == 3);
+        for(const auto& error : e.exceptions()){
+            try{ std::rethrow_exception(error); }
+            catch(const std::runtime_error&){ }
+        }
+    }
+}
+
+void test_fail_fast_task_group_skips_pending_siblings()
+{
+    thread_pool pool(1);
+    std::atomic<int> ran(0);
+    task_group group(pool, failure_policy::fail_fast);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::promise<void> started;
+    group.spawn([&]{
+        started.set_value();
+        go.wait();
+        throw std::runtime_error("first");
+    });
+    started.get_future().wait();
+    for(int i=0; i<10; ++i){
+        group.spawn([&ran]{ ++ran; });
+    }
+    release.set_value();
+    // wait() would otherwise run the siblings itself before the failure
+    while(!group.is_cancelled()){
+        std::this_thread::yield();
+    }
+    bool thrown = false;
+    try{ group.wait(); }
+    catch(const std::runtime_error&){ thrown = true; }
+    assert(thrown && ran == 0);
+
+    // the next round starts afresh
+    group.spawn([&ran]{ ++ran; });
+    group.wait();
+    assert(ran == 1);
+}
+
+void test_higher_priority_lanes_run_first()
+{
+    thread_pool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened(gate.get_future());
+    pool.submit([opened]{ opened.wait(); });
+
+    std::mutex m;
+    std::vector<char> order;
+    auto record = [&m, &order](char c){
+        return [&m, &order, c]{
+            std::lock_guard<std::mutex> lk(m);
+            order.push_back(c);
+        };
+    };
+    pool.submit(record('b'), task_priority::background);
+    pool.submit(record('n'), task_priority::normal);
+    // waiting on a pool_future would run tasks here too, in parallel with
+    // the worker, so the order would no longer be deterministic
+    auto last = pool.submit_std(record('c'), task_priority::critical);
+    gate.set_value();
+    last.get();
+    pool.submit_std([]{}, task_priority::background).get();
+
+    assert((order == std::vector<char>{'c','n','b'}));
+}
+
+void test_background_lane_is_not_starved()
+{
+    thread_pool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened(gate.get_future());
+    pool.submit([opened]{ opened.wait(); });
+
+    std::atomic<int> critical_done(0);
+    int critical_done_before_background{-1};
+    auto background = pool.submit_std([&]{
+        critical_done_before_background = critical_done;
+    }, task_priority::background);
+    std::vector<pool_future<void>> critical;
+    for(int i=0; i<200; ++i){
+        critical.push_back(pool.submit([&critical_done]{ ++critical_done; },
+                                       task_priority::critical));
+    }
+    gate.set_value();
+    background.get();
+    assert(critical_done_before_background < 200);
+    for(auto& f : critical){
+        f.get();
+    }
+}
+
+
+void test_pinned_workers_run_tasks()
+{
+    placement_policy placement;
+    placement.pin_workers = true;
+    thread_pool pool(4, idle_policy(), placement);
+    std::atomic<int> counter(0);
+    pool.submit_n(1000, [&counter](std::size_t){ ++counter; }).get();
+    assert(counter == 1000);
+}
+
+void test_metrics_report_per_worker_activity()
+{
+    thread_pool pool(4);
+    // waiting on a std::future does not help, so the workers run every task
+    std::vector<std::future<void>> results;
+    for(int i=0; i<4; ++i){
+        // spread the work over the workers' local queues and let them steal
+        results.push_back(pool.submit_std([&pool]{
+            std::vector<pool_future<void>> inner;
+            for(int j=0; j<100; ++j){
+                inner.push_back(pool.submit([]{ }));
+            }
+            for(auto& f : inner){
+                while(f.wait_for(std::chrono::seconds(0)) !=
+                      std::future_status::ready){
+                    pool.run_pending_task();
+                }
+            }
+        }));
+    }
+    for(auto& r : results){
+        r.get();
+    }
+    pool_metrics metrics = pool.metrics();
+    while(metrics.total().tasks_executed < 404){
+        std::this_thread::yield();
+        metrics = pool.metrics();
+    }
+    const worker_metrics total = metrics.total();
+    assert(metrics.workers.size() == 8);    // including the spare slots
+    assert(total.tasks_executed == 404);
+    assert(total.steal_successes <= total.steal_attempts);
+    assert(total.tasks_stolen >= total.steal_successes);
+    assert(total.queue_depth == 0 && metrics.pool_queue_depth == 0);
+    assert(pool.steal_stats().attempts == total.steal_attempts);
+}
+
+void test_cancelled_tasks_are_skipped()
+{
+    thread_pool pool(1);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    auto blocker = pool.submit([go]{ go.wait(); });
+
+    cancellation_source source;
+    std::atomic<int> ran(0);
+    auto skipped = pool.submit(source.token(), [&ran]{ ++ran; return 1; });
+    pool.post(source.token(), [&ran]{ ++ran; });
+    cancellation_source other;
+    auto kept = pool.submit(other.token(), [&ran]{ ++ran; return 2; });
+    source.cancel();
+    release.set_value();
+
+    blocker.get();
+    assert(kept.get() == 2);
+    try{
+        skipped.get();
+        assert(false);
+    }
+    catch(const task_cancelled&) { }
+    pool.submit([]{ }).get();
+    assert(ran == 1);
+}
+
+void test_cancelled_task_group_skips_pending_children()
+{
+    thread_pool pool(1);
+    cancellation_source source;
+    std::atomic<int> ran(0);
+    task_group group(pool, source.token());
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::promise<void> started;
+    group.spawn([&]{
+        started.set_value();
+        go.wait();
+        // a running child sees the cancellation by polling
+        if(!group.is_cancelled()) ++ran;
+    });
+    started.get_future().wait();
+    for(int i=0; i<10; ++i){
+        group.spawn([&ran]{ ++ran; });
+    }
+    source.cancel();
+    release.set_value();
+    group.wait();
+    assert(ran == 0);
+}
+
+void test_delayed_tasks_run_in_deadline_order()
+{
+    idle_policy idle;
+    idle.spin_rounds = 1;
+    idle.yield_rounds = 1;
+    thread_pool pool(2, idle);
+    const auto start = std::chrono::steady_clock::now();
+    std::mutex m;
+    std::vector<int> order;
+    std::vector<pool_future<void>> results;
+    for(int i=5; i>0; --i){
+        results.push_back(pool.submit_after(std::chrono::milliseconds(10*i),
+            [&m, &order, i]{
+                std::lock_guard<std::mutex> lk(m);
+                order.push_back(i);
+            }));
+    }
+    auto late = pool.submit_at(start + std::chrono::milliseconds(60), []{
+        return std::chrono::steady_clock::now(); });
+    assert(late.get() >= start + std::chrono::milliseconds(60));
+    for(auto& r : results){
+        r.get();
+    }
+    assert((order == std::vector<int>{1, 2, 3, 4, 5}));
+    // already due, so it goes straight to the queue
+    assert(pool.submit_after(std::chrono::milliseconds(0), []{ return 1; }).get() == 1);
+}
+
+void test_thousands_of_timers()
+{
+    thread_pool pool(2);
+    std::atomic<int> fired(0);
+    std::vector<pool_future<void>> results;
+    for(int i=0; i<5000; ++i){
+        results.push_back(pool.submit_after(std::chrono::microseconds(7*i),
+            [&fired]{ ++fired; }));
+    }
+    for(auto& r : results){
+        r.get();
+    }
+    assert(fired == 5000);
+}
+
+void test_elastic_pool_keeps_a_worker_for_timers()
+{
+    elastic_policy resize;
+    resize.min_threads = 0;
+    resize.max_threads = 2;
+    resize.retire_after = std::chrono::milliseconds(5);
+    thread_pool pool(resize);
+    assert(pool.worker_count() == 0);
+    auto res = pool.submit_after(std::chrono::milliseconds(30), []{ return 7; });
+    assert(res.get() == 7);
+}
+
+void test_blocked_worker_is_compensated()
+{
+    thread_pool pool(1);
+    // the only worker blocks on a task queued behind it, which a
+    // compensating worker has to steal
+    auto outer = pool.submit([&pool]{
+        auto inner = pool.submit([]{ return 5; });
+        return pool.managed_block([&inner]{ return inner.get(); });
+    });
+    assert(outer.get() == 5);
+
+    // the compensating worker retires once the blocked one is back
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(pool.worker_count() > 1 &&
+          std::chrono::steady_clock::now() < deadline){
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(pool.worker_count() == 1);
+    assert(pool.submit([]{ return 1; }).get() == 1);
+}
+
+void test_all_workers_blocked_at_once()
+{
+    thread_pool pool(2);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::vector<pool_future<void>> blocked;
+    for(int i=0; i<2; ++i){
+        blocked.push_back(pool.submit([&pool, go]{
+            thread_pool::blocking_region region(pool);
+            go.wait();
+        }));
+    }
+    // both workers are stuck, yet this still runs
+    pool.submit([&release]{ release.set_value(); }).get();
+    for(auto& b : blocked){
+        b.get();
+    }
+    // outside the pool's workers it simply runs the function
+    assert(pool.managed_block([]{ return 3; }) == 3);
+}
+
+void test_nested_blocking_regions_compensate_once()
+{
+    thread_pool pool(2);
+    // a std::future, so that this thread does not run the task itself
+    auto counts = pool.submit_std([&pool]{
+        thread_pool::blocking_region outer(pool);
+        const unsigned in_outer = pool.worker_count();
+        unsigned in_inner;
+        {
+            thread_pool::blocking_region inner(pool);
+            in_inner = pool.worker_count();
+        }
+        return std::make_pair(in_outer, in_inner);
+    });
+    const auto [in_outer, in_inner] = counts.get();
+    assert(in_outer == 3);
+    assert(in_inner == 3);
+}
+
+void test_submit_to_runs_on_the_chosen_worker()
+{
+    thread_pool pool(4);
+    for(unsigned worker=0; worker<4; ++worker){
+        // the worker is held up while its next task waits in the mailbox,
+        // and the other, idle, workers have to leave that task alone
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> go(release.get_future());
+        auto gated = pool.submit_to(worker, [&started, go]{
+            started.set_value();
+            go.wait();
+            return std::this_thread::get_id(); });
+        started.get_future().wait();
+        auto queued = pool.submit_to(worker, []{
+            return std::this_thread::get_id(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(!queued.is_ready());
+        release.set_value();
+        const std::thread::id first = gated.get();
+        assert(queued.get() == first);
+
+        for(int i=0; i<10; ++i){
+            assert(pool.submit_to(worker, []{
+                return std::this_thread::get_id(); }).get() == first);
+        }
+        // the index wraps round
+        assert(pool.submit_to(worker+4, []{
+            return std::this_thread::get_id(); }).get() == first);
+    }
+}
+
+void test_mailbox_backlog_is_stolen()
+{
+    thread_pool pool(2);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    auto busy_id = pool.submit_to(0, [go]{
+        go.wait();
+        return std::this_thread::get_id(); });
+    std::atomic<int> ran(0);
+    std::vector<pool_future<std::thread::id>> results;
+    for(int i=0; i<10; ++i){
+        results.push_back(pool.submit_to(0, [&ran]{
+            ++ran;
+            return std::this_thread::get_id(); }));
+    }
+    // the other worker works through all but the last one
+    while(ran < 9){
+        std::this_thread::yield();
+    }
+    release.set_value();
+    const std::thread::id owner = busy_id.get();
+    int on_owner = 0;
+    for(auto& r : results){
+        on_owner += r.get() == owner;
+    }
+    assert(on_owner <= 1);
+}
+
+void test_mailbox_task_of_a_blocked_worker_is_taken_over()
+{
+    thread_pool pool(2);
+    // the task blocks on one it has sent to its own worker's mailbox
+    auto outer = pool.submit_to(0, [&pool]{
+        std::promise<int> answer;
+        std::future<int> result = answer.get_future();
+        pool.submit_to(0, [&answer]{ answer.set_value(42); });
+        return pool.managed_block([&result]{ return result.get(); });
+    });
+    assert(outer.get() == 42);
+}
+
+void test_elastic_pool_grows_and_shrinks()
+{
+    elastic_policy resize;
+    resize.min_threads = 1;
+    resize.max_threads = 4;
+    resize.grow_backlog = 1;
+    resize.grow_interval = std::chrono::microseconds(0);
+    resize.retire_after = std::chrono::milliseconds(20);
+    thread_pool pool(resize);
+    assert(pool.worker_count() == 1);
+
+    // tasks that block until all four are running at once
+    std::atomic<int> started(0);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::vector<pool_future<void>> results;
+    for(int i=0; i<16; ++i){
+        results.push_back(pool.submit([&started, go]{
+            ++started;
+            go.wait();
+        }));
+    }
+    while(started < 4){
+        std::this_thread::yield();
+    }
+    assert(pool.worker_count() == 4);
+    release.set_value();
+    for(auto& r : results){
+        r.get();
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(pool.worker_count() > resize.min_threads &&
+          std::chrono::steady_clock::now() < deadline){
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    assert(pool.worker_count() == resize.min_threads);
+    // a retired worker's slot is reused when the pool grows again
+    pool.submit_n(100, [](std::size_t){ }).get();
+}
+
+template<typename Future>
+bool holds_broken_promise(Future& res)
+{
+    try{
+        res.get();
+    }
+    catch(const std::future_error& e){
+        return e.code() == std::future_errc::broken_promise;
+    }
+    return false;
+}
+
+void test_shutdown_drains_queued_and_spawned_tasks()
+{
+    thread_pool pool(2);
+    std::atomic<int> ran(0);
+    std::vector<pool_future<void>> results;
+    for(int i=0; i<50; ++i){
+        results.push_back(pool.submit([&pool, &ran]{
+            ++ran;
+            pool.post([&ran]{ ++ran; });
+        }));
+    }
+    auto delayed = pool.submit_after(std::chrono::milliseconds(20), []{ return 3; });
+    pool.shutdown();
+    assert(ran == 100);
+    assert(delayed.get() == 3);
+    assert(pool.worker_count() == 0);
+    auto late = pool.submit([]{ return 1; });
+    assert(holds_broken_promise(late));
+    pool.shutdown();
+}
+
+void test_shutdown_discards_pending_tasks()
+{
+    thread_pool pool(1);
+    std::promise<void> release;
+    std::shared_future<void> go(release.get_future());
+    std::promise<void> running;
+    auto blocker = pool.submit([&running, go]{
+        running.set_value();
+        go.wait();
+    });
+    running.get_future().wait();
+    std::vector<pool_future<int>> results;
+    for(int i=0; i<10; ++i){
+        results.push_back(pool.submit([i]{ return i; }));
+    }
+    results.push_back(pool.submit_to(0, []{ return 10; }));
+    auto delayed = pool.submit_after(std::chrono::hours(1), []{ return 0; });
+
+    std::thread stopper([&pool]{
+        pool.shutdown(drain_policy{drain_mode::discard});
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    release.set_value();
+    stopper.join();
+    blocker.get();
+    assert(holds_broken_promise(delayed));
+    for(auto& r : results){
+        // only if shutdown() had not begun by the time the blocker finished
+        try{
+            r.get();
+        }
+        catch(const std::future_error& e){
+            assert(e.code() == std::future_errc::broken_promise);
+        }
+    }
+}
+
+void test_shutdown_deadline_bounds_the_drain()
+{
+    thread_pool pool(2);
+    auto delayed = pool.submit_after(std::chrono::hours(1), []{ return 0; });
+    auto queued = pool.submit([]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return 1;
+    });
+    // long enough for the workers to have parked waiting for the timer
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    const auto start = std::chrono::steady_clock::now();
+    pool.shutdown(drain_policy{drain_mode::drain_with_deadline,
+                               start + std::chrono::milliseconds(20)});
+    assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    assert(queued.get() == 1);
+    assert(holds_broken_promise(delayed));
+}
+
+int main()
+{
+    test_submit_from_outside_the_pool();
+    test_nested_submit_runs_from_local_queues();
+    test_local_queue_overflow_still_runs();
+    test_parked_workers_wake_up_for_new_work();
+    test_submit_bulk_returns_a_future_per_task();
+    test_submit_n_completes_once_all_tasks_ran();
+    test_higher_priority_lanes_run_first();
+    test_background_lane_is_not_starved();
+    test_task_group_fork_join();
+    test_task_group_rethrows_child_exception();
+    test_task_group_aggregates_child_exceptions();
+    test_fail_fast_task_group_skips_pending_siblings();
+    test_pinned_workers_run_tasks();
+    test_metrics_report_per_worker_activity();
+    test_cancelled_tasks_are_skipped();
+    test_cancelled_task_group_skips_pending_children();
+    test_delayed_tasks_run_in_deadline_order();
+    test_thousands_of_timers();
+    test_elastic_pool_keeps_a_worker_for_timers();
+    test_blocked_worker_is_compensated();
+    test_all_workers_blocked_at_once();
+    test_nested_blocking_regions_compensate_once();
+    test_submit_to_runs_on_the_chosen_worker();
+    test_mailbox_backlog_is_stolen();
+    test_mailbox_task_of_a_blocked_worker_is_taken_over();
+    test_elastic_pool_grows_and_shrinks();
+    test_idle_workers_steal_a_busy_workers_tasks();
+    test_shutdown_drains_queued_and_spawned_tasks();
+    test_shutdown_discards_pending_tasks();
+    test_shutdown_deadline_bounds_the_drain();
+}
@@ -1,6 +1,8 @@
 #ifndef THREADSAFE_QUEUE_HPP_
 #define THREADSAFE_QUEUE_HPP_
 
+#include <cstddef>
+#include <iterator>
 #include <memory>
 #include <utility>
 #include <mutex>
@@ -26,6 +28,7 @@ public:
     threadsafe_queue()
         : head(new node), tail(head.get())
         { }
+    ~threadsafe_queue();
     threadsafe_queue( const threadsafe_queue& ) = delete;
     threadsafe_queue& operator=( const threadsafe_queue& ) = delete;
 
@@ -36,6 +39,14 @@ public:
     void push(T new_value);
     template<typename... Args>
     void emplace( Args&&... args );
+    template<typename InputIt>
+    void push_range( InputIt first, InputIt last );
+    template<typename OutputIt>
+    std::size_t try_pop_bulk( OutputIt out, std::size_t max_n );
+    template<typename OutputIt>
+    std::size_t wait_and_pop_bulk( OutputIt out, std::size_t max_n );
+    template<typename Container>
+    std::size_t drain( Container& values );
     bool empty();
 
 private:
@@ -46,9 +57,22 @@ private:
     std::unique_ptr<node> wait_pop_head(T& value);
     std::unique_ptr<node> try_pop_head();
     std::unique_ptr<node> try_pop_head(T& value);
+    std::unique_ptr<node> pop_run(std::size_t max_n);
+    template<typename OutputIt>
+    static std::size_t move_run(std::unique_ptr<node> run, OutputIt out);
 };
 
 
+// Frees the nodes one at a time, as destroying head would free the chain
+// recursively, once per node.
+template<typename T>
+threadsafe_queue<T>::~threadsafe_queue()
+{
+    while(head){
+        head = std::move( head->next );
+    }
+}
+
 template<typename T>
 void threadsafe_queue<T>::push(T new_value)
 {
@@ -78,6 +102,31 @@ void threadsafe_queue<T>::emplace( Args&&... args )
     data_cond.notify_one();
 }
 
+// Moves the whole range in under a single tail lock. The nodes are chained
+// up before the lock is taken, so it is only held to splice the chain in.
+template<typename T>
+    template<typename InputIt>
+void threadsafe_queue<T>::push_range( InputIt first, InputIt last )
+{
+    if(first == last){
+        return;
+    }
+    auto first_data( std::make_shared<T>(std::move(*first)) );
+    auto chain( std::make_unique<node>() );
+    node* chain_tail( chain.get() );
+    for(++first; first != last; ++first){
+        chain_tail->data = std::make_shared<T>(std::move(*first));
+        chain_tail->next = std::make_unique<node>();
+        chain_tail = chain_tail->next.get();
+    }
+    { std::lock_guard<std::mutex> tail_lock(tail_mutex);
+        tail->data = first_data;
+        tail->next = std::move(chain);
+        tail = chain_tail;
+    }
+    data_cond.notify_all();
+}
+
 template<typename T>
 typename threadsafe_queue<T>::node* threadsafe_queue<T>::get_tail()
 {
@@ -97,13 +146,13 @@ std::unique_lock<std::mutex> threadsafe_queue<T>::wait_for_data()
 {
     std::unique_lock<std::mutex> head_lock(head_mutex);
     data_cond.wait( head_lock, [this]{ return head.get() != get_tail(); } );
-    return std::move(head_lock);
+    return head_lock;
 }
 template<typename T>
 std::unique_ptr<typename threadsafe_queue<T>::node>
 threadsafe_queue<T>::wait_pop_head()
 {
-    std::unique_ptr<std::mutex> head_lock(wait_for_data());
+    std::unique_lock<std::mutex> head_lock(wait_for_data());
     return pop_head();
 }
 template<typename T>
@@ -152,6 +201,78 @@ threadsafe_queue<T>::try_pop_head(T& value)
     return pop_head();
 }
 
+// Detaches up to max_n nodes from the front; the head lock must be held.
+// Only the pointers are walked here, the values are moved out by move_run()
+// once the lock has been released.
+template<typename T>
+std::unique_ptr<typename threadsafe_queue<T>::node>
+threadsafe_queue<T>::pop_run(std::size_t max_n)
+{
+    node* const last( get_tail() );
+    node* prev( nullptr );
+    node* n( head.get() );
+    for(std::size_t count=0; count != max_n && n != last; ++count){
+        prev = n;
+        n = n->next.get();
+    }
+    if(!prev){
+        return nullptr;
+    }
+    auto run( std::move(head) );
+    head = std::move( prev->next );
+    return run;
+}
+
+// Frees the run one node at a time, as destroying the chain in one go
+// would recurse once per node.
+template<typename T>
+    template<typename OutputIt>
+std::size_t threadsafe_queue<T>::move_run(std::unique_ptr<node> run, OutputIt out)
+{
+    std::size_t count( 0 );
+    while(run){
+        *out = std::move( *run->data );
+        ++out;
+        ++count;
+        run = std::move( run->next );
+    }
+    return count;
+}
+
+template<typename T>
+    template<typename OutputIt>
+std::size_t threadsafe_queue<T>::try_pop_bulk( OutputIt out, std::size_t max_n )
+{
+    std::unique_ptr<node> run;
+    { std::lock_guard<std::mutex> head_lock(head_mutex);
+        run = pop_run(max_n);
+    }
+    return move_run(std::move(run), out);
+}
+
+// Waits for at least one value, then takes up to max_n.
+template<typename T>
+    template<typename OutputIt>
+std::size_t threadsafe_queue<T>::wait_and_pop_bulk( OutputIt out, std::size_t max_n )
+{
+    if(max_n == 0){
+        return 0;
+    }
+    std::unique_ptr<node> run;
+    { std::unique_lock<std::mutex> head_lock(wait_for_data());
+        run = pop_run(max_n);
+    }
+    return move_run(std::move(run), out);
+}
+
+// Appends everything in the queue to values.
+template<typename T>
+    template<typename Container>
+std::size_t threadsafe_queue<T>::drain( Container& values )
+{
+    return try_pop_bulk( std::back_inserter(values), static_cast<std::size_t>(-1) );
+}
+
 template<typename T>
 std::shared_ptr<T> threadsafe_queue<T>::try_pop()
 {
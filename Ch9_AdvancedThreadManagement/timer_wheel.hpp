@@ -0,0 +1,248 @@
+#ifndef TIMER_WHEEL_HPP_
+#define TIMER_WHEEL_HPP_
+
+/*
+** Hierarchical timing wheel (Varghese & Lauck, "Hashed and Hierarchical
+** Timing Wheels"), laid out like the Linux kernel's timer wheel.
+** Time is counted in ticks of a fixed resolution. Level 0 has one slot per
+** tick for the next 64 ticks, level 1 one slot per 64 ticks for the next
+** 64^2, and so on. A timer is filed in the lowest level whose range covers
+** its deadline. Once the clock reaches a higher level slot, its timers are
+** re-filed one level down ("cascaded"), until they reach level 0 and
+** expire. Scheduling is O(1), and each timer is cascaded at most once per
+** level. Deadlines beyond the top level's range are parked in its farthest
+** slot and re-filed from there.
+** Not synchronized - the owner has to serialize access.
+*/
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+
+
+template<typename T>
+class timer_wheel
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    static constexpr unsigned level_bits = 6;
+    static constexpr unsigned slot_count = 1u << level_bits;
+    static constexpr unsigned level_count = 4;
+    static constexpr std::uint64_t slot_mask = slot_count-1;
+    static constexpr std::int64_t max_delta =
+        (std::int64_t(1) << (level_bits*level_count)) - 1;
+
+    struct node
+    {
+        T value;
+        std::int64_t deadline;  // in ticks
+        std::unique_ptr<node> next;
+
+        node(T value_, std::int64_t deadline_)
+            : value(std::move(value_)), deadline(deadline_)
+            { }
+    };
+
+    const clock::duration resolution;
+    const clock::time_point start;
+    std::int64_t current;   // last tick processed
+    std::size_t count;
+    std::unique_ptr<node> slots[level_count][slot_count];
+    std::uint64_t occupied[level_count];    // one bit per non-empty slot
+
+    std::int64_t ticks_until(clock::time_point when) const
+    {
+        return (when - start) / resolution;
+    }
+
+    static unsigned slot_index(std::int64_t tick, unsigned level)
+    {
+        return static_cast<unsigned>(
+            (static_cast<std::uint64_t>(tick) >> (level*level_bits)) & slot_mask);
+    }
+
+    // files n relative to current; n->deadline > current
+    void file(std::unique_ptr<node> n)
+    {
+        const std::int64_t delta = n->deadline - current;
+        std::int64_t expiry = n->deadline;
+        unsigned level = 0;
+        if(delta > max_delta){
+            expiry = current + max_delta;
+            level = level_count-1;
+        }
+        else{
+            while(delta >= (std::int64_t(1) << ((level+1)*level_bits))){
+                ++level;
+            }
+        }
+        const unsigned index = slot_index(expiry, level);
+        n->next = std::move(slots[level][index]);
+        slots[level][index] = std::move(n);
+        occupied[level] |= std::uint64_t(1) << index;
+    }
+
+    std::unique_ptr<node> take_slot(unsigned level, unsigned index)
+    {
+        occupied[level] &= ~(std::uint64_t(1) << index);
+        return std::move(slots[level][index]);
+    }
+
+    // re-files the slot of the given level which the clock has just reached;
+    // returns true if the level has wrapped, so the next one is due as well
+    bool cascade(unsigned level)
+    {
+        const unsigned index = slot_index(current, level);
+        std::unique_ptr<node> list(take_slot(level, index));
+        while(list){
+            std::unique_ptr<node> next(std::move(list->next));
+            if(list->deadline <= current){
+                // due this very tick, level 0 is processed next
+                const unsigned now_index = slot_index(current, 0);
+                list->next = std::move(slots[0][now_index]);
+                slots[0][now_index] = std::move(list);
+                occupied[0] |= std::uint64_t(1) << now_index;
+            }
+            else{
+                file(std::move(list));
+            }
+            list = std::move(next);
+        }
+        return index == 0;
+    }
+
+    static unsigned first_set_from(std::uint64_t mask, unsigned from)
+    {
+        const std::uint64_t rotated = from ?
+            (mask >> from) | (mask << (slot_count-from)) : mask;
+        return static_cast<unsigned>(__builtin_ctzll(rotated));
+    }
+
+    // the first tick after current at which an occupied slot is reached
+    std::int64_t next_event_tick() const
+    {
+        std::int64_t earliest = std::numeric_limits<std::int64_t>::max();
+        for(unsigned level=0; level<level_count; ++level){
+            if(!occupied[level]){
+                continue;
+            }
+            // first tick after current at which this level's slots move on
+            const std::int64_t unit = std::int64_t(1) << (level*level_bits);
+            const std::int64_t next_step = (current/unit + 1) * unit;
+            const unsigned distance =
+                first_set_from(occupied[level], slot_index(next_step, level));
+            const std::int64_t tick = next_step + distance*unit;
+            if(tick < earliest){
+                earliest = tick;
+            }
+        }
+        return earliest;
+    }
+
+public:
+    explicit timer_wheel(clock::duration resolution_ = std::chrono::milliseconds(1),
+                         clock::time_point start_ = clock::now())
+        : resolution(resolution_), start(start_)
+        , current(0), count(0), occupied()
+        { }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    ~timer_wheel()
+    {
+        clear();
+    }
+
+    std::size_t size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    // destroys every pending value without expiring it
+    void clear() noexcept
+    {
+        // unlink iteratively, a long slot would otherwise recurse deeply
+        for(auto& level : slots){
+            for(auto& slot : level){
+                while(slot){
+                    slot = std::move(slot->next);
+                }
+            }
+        }
+        for(auto& mask : occupied){
+            mask = 0;
+        }
+        count = 0;
+    }
+
+    // Returns false, leaving value untouched, if when is already due -
+    // running it is then up to the caller. Timers never fire early, but may
+    // fire up to one tick late.
+    bool schedule(clock::time_point when, T& value)
+    {
+        if(when <= start){
+            return false;
+        }
+        // round up to the next whole tick; when + resolution could overflow
+        // for a deadline as far off as time_point::max()
+        const clock::duration after_start = when - start;
+        const std::int64_t deadline = after_start / resolution +
+            (after_start % resolution != clock::duration::zero() ? 1 : 0);
+        if(deadline <= current){
+            return false;
+        }
+        file(std::unique_ptr<node>(new node(std::move(value), deadline)));
+        ++count;
+        return true;
+    }
+
+    // Moves the clock up to now and passes every expired value to expire,
+    // returning how many there were. Costs O(1) per expired or cascaded
+    // timer, however many ticks have passed.
+    template<typename Expire>
+    std::size_t advance(clock::time_point now, Expire expire)
+    {
+        const std::int64_t target = ticks_until(now);
+        std::size_t expired = 0;
+        while(current < target){
+            // nothing happens in the ticks in between, so skip them
+            const std::int64_t next = count ? next_event_tick() : target+1;
+            if(next > target){
+                current = target;
+                break;
+            }
+            current = next;
+            for(unsigned level=1;
+                level < level_count && slot_index(current, level-1) == 0 &&
+                cascade(level);
+                ++level)
+                { }
+            std::unique_ptr<node> list(take_slot(0, slot_index(current, 0)));
+            while(list){
+                std::unique_ptr<node> next(std::move(list->next));
+                --count;
+                ++expired;
+                expire(std::move(list->value));
+                list = std::move(next);
+            }
+        }
+        return expired;
+    }
+
+    // No later than the earliest deadline: the time at which the next slot
+    // is either expired or cascaded. time_point::max() if there are no timers.
+    clock::time_point next_event() const
+    {
+        if(!count){
+            return clock::time_point::max();
+        }
+        return start + next_event_tick()*resolution;
+    }
+};
+
+
+#endif /* TIMER_WHEEL_HPP_ */
@@ -3,73 +3,190 @@
 
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstddef>
 #include <future>
 #include <vector>
 #include <type_traits>
-#include "threadsafe_queue.hpp"
+#include "priority_work_queue.hpp"
 #include "function_wrapper.hpp"
 #include "join_threads.hpp"
+#include "idle_policy.hpp"
+#include "cpu_topology.hpp"
+#include "bulk_submit.hpp"
+#include "pool_metrics.hpp"
+#include "drain_policy.hpp"
 
 
 class thread_pool
 {
     std::atomic_bool done;
-    threadsafe_queue<function_wrapper> work_queue;
+    // set by shutdown(); the workers stop picking up tasks at drain_deadline
+    // and leave once there are none left
+    std::atomic_bool draining;
+    std::chrono::steady_clock::time_point drain_deadline;
+    std::mutex shutdown_mutex;
+    priority_work_queue<function_wrapper> work_queue;
+    const idle_policy idle;
+    event_count work_available;
+    std::vector<worker_counters> counters;
     std::vector<std::thread> threads;
     join_threads joiner;
 
+    bool past_drain_deadline() const
+    {
+        return draining && std::chrono::steady_clock::now() >= drain_deadline;
+    }
+
 // --- modified code
-    void worker_thread()
+    void worker_thread(unsigned index)
     {
-        while(!done){
+        worker_counters& mine = counters[index];
+        idle_backoff backoff(idle);
+        while(!done && !past_drain_deadline()){
             function_wrapper task;
             if(work_queue.try_pop(task)){
                 task();
+                mine.task_executed();
+                backoff.reset();
+            }
+            else if(draining){
+                break;
             }
             else{
-                std::this_thread::yield();
+                idle_timer timer(mine);
+                backoff.idle(work_available, [this]{
+                    return done || draining || !work_queue.empty(); });
             }
         }
     }
 // --- modified code
 
+    void enqueue_batch(std::vector<function_wrapper>& tasks)
+    {
+        if(done){
+            return;
+        }
+        work_queue.push_range(tasks.begin(), tasks.end());
+        work_available.notify(tasks.size());
+    }
+
 public:
 
-    thread_pool()
-        : done(false), joiner(threads)
+    explicit thread_pool(
+        unsigned thread_count = std::thread::hardware_concurrency(),
+        const idle_policy& idle_ = idle_policy(),
+        const placement_policy& placement = placement_policy())
+        : done(false), draining(false), idle(idle_), counters(thread_count)
+        , joiner(threads)
     {
-        const unsigned thread_count = std::thread::hardware_concurrency();
         try{
             for(unsigned i=0; i<thread_count; ++i){
                 threads.push_back(
-                    std::thread(&thread_pool::worker_thread,this) );
+                    std::thread(&thread_pool::worker_thread,this,i) );
+            }
+            if(placement.pin_workers){
+                const cpu_topology topology;
+                for(unsigned i=0; i<threads.size(); ++i){
+                    cpu_topology::pin(threads[i], topology.cpu_for_worker(i));
+                }
             }
         }
         catch(...){
             done = true;
+            work_available.notify_all();
             throw;
         }
     }
 
+    // Whatever the pool has not started yet is discarded, unless it has
+    // already been shut down with another policy.
     ~thread_pool()
     {
+        shutdown(drain_policy{drain_mode::discard});
+    }
+
+    // Stops the pool and joins its workers. Unless the policy discards them,
+    // the workers first run the queued tasks, those submitted by the running
+    // ones included, and leave once there are none left or the deadline has
+    // passed. Whatever is still queued after that is destroyed without
+    // running, and tasks submitted once shutdown() has returned are dropped
+    // at once. Later calls return right away; it must not be called from
+    // one of the pool's own tasks.
+    void shutdown(const drain_policy& policy = drain_policy())
+    {
+        std::lock_guard<std::mutex> lk(shutdown_mutex);
+        if(done){
+            return;
+        }
+        drain_deadline = policy.stop_at();
+        draining = true;
+        work_available.notify_all();
+        for(auto& t : threads){
+            if(t.joinable()){
+                t.join();
+            }
+        }
         done = true;
+        function_wrapper task;
+        while(work_queue.try_pop(task)){
+            task = function_wrapper();
+        }
     }
 
 // --- modified code
+    // higher priority tasks are always picked first, apart from the
+    // occasional background task let through to avoid starving that lane
     template<typename FunctionType>
-    std::future<std::result_of_t<FunctionType()>>
-    submit(FunctionType f)
+    std::future<std::invoke_result_t<FunctionType>>
+    submit(FunctionType f, task_priority priority = task_priority::normal)
     {
-        using result_type = std::result_of_t<FunctionType()>;
+        using result_type = std::invoke_result_t<FunctionType>;
 
-        std::packaged_task<reslt_type()> task(std::move(f));
+        std::packaged_task<result_type()> task(std::move(f));
         std::future<result_type> res(task.get_future());
-        work_queue.push(std::move(task));
+        if(done){
+            return res;
+        }
+        work_queue.push(std::move(task), priority);
+        work_available.notify_one();
         return res;
     }
 // --- modified code
 
+    // Moves the callables out of [first,last) and enqueues them all with a
+    // single synchronization and wake-up.
+    template<typename InputIt>
+    std::vector<std::future<bulk_result_t<InputIt>>>
+    submit_bulk(InputIt first, InputIt last)
+    {
+        using result_type = bulk_result_t<InputIt>;
+
+        std::vector<function_wrapper> tasks;
+        std::vector<std::future<result_type>> res;
+        for(; first != last; ++first){
+            std::packaged_task<result_type()> task(std::move(*first));
+            res.push_back(task.get_future());
+            tasks.push_back(std::move(task));
+        }
+        enqueue_batch(tasks);
+        return res;
+    }
+
+    // Runs f(0) ... f(n-1) on the pool; the returned future becomes ready
+    // when all of them have finished and rethrows the first exception.
+    template<typename FunctionType>
+    std::future<void> submit_n(std::size_t n, FunctionType f)
+    {
+        std::vector<function_wrapper> tasks;
+        tasks.reserve(n);
+        std::future<void> res( make_batch_tasks(n, std::move(f),
+            [&tasks](function_wrapper task){ tasks.push_back(std::move(task)); }) );
+        enqueue_batch(tasks);
+        return res;
+    }
+
 // --- modified code
 // avoid deadlocks by allowing running tasks synchronously while waiting for
 // pending tasks to finish
@@ -84,6 +201,17 @@ public:
         }
     }
 // --- modified code
+
+    // Only tasks picked up by the workers' own loops are counted.
+    pool_metrics metrics() const
+    {
+        pool_metrics res;
+        res.pool_queue_depth = work_queue.size();
+        for(const auto& worker : counters){
+            res.workers.push_back(worker.read());
+        }
+        return res;
+    }
 };
 
 
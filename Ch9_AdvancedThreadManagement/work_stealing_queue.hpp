@@ -1,57 +1,165 @@
 #ifndef WORK_STEALING_QUEUE_HPP_
 #define WORK_STEALING_QUEUE_HPP_
 
-#include <deque>
-#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
 #include "function_wrapper.hpp"
 
 
+// Lock-free work-stealing deque using the top/bottom index protocol of Chase
+// & Lev, "Dynamic Circular Work-Stealing Deque", with the memory orderings
+// of Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models".
+// try_push() and try_pop() may only be called by the thread owning the
+// queue, try_steal() by any thread.
+// Unlike the paper's deque this one does not grow. Its elements are
+// function_wrappers, which cannot be read speculatively the way the paper's
+// thieves read a slot, and a growable array would have to box each task on
+// the heap; instead the tasks sit by value in a fixed ring, so pushing a
+// task does not allocate. A thief only moves a task out after its CAS on top
+// has claimed it, and each slot carries a flag the thief clears once it is
+// done, so that the owner never overwrites a slot still being read. A full
+// ring makes try_push() fail, and the pool puts the task on its shared queue
+// instead - a worker with over capacity tasks of its own has plenty to be
+// getting on with, and the overflow is there for the others to take.
 class work_stealing_queue
 {
 private:
     using data_type = function_wrapper;
-    std::deque<data_type> the_queue;
-    mutable std::mutex the_mutex;
+    static constexpr std::int64_t capacity = 1024;
+    static constexpr std::int64_t mask = capacity - 1;
+
+    // top and bottom live on separate cache lines: thieves hammer top while
+    // the owner keeps updating bottom
+    alignas(64) std::atomic<std::int64_t> top;
+    alignas(64) std::atomic<std::int64_t> bottom;
+    std::unique_ptr<data_type[]> slots;
+    std::unique_ptr<std::atomic<bool>[]> full;
+
+    // owner only; once it holds, try_push() cannot fail until the owner
+    // pushes again, as thieves only ever free slots
+    bool has_room() const
+    {
+        const std::int64_t b = bottom.load(std::memory_order_relaxed);
+        const std::int64_t t = top.load(std::memory_order_acquire);
+        return b - t < capacity &&
+               !full[b & mask].load(std::memory_order_acquire);
+    }
+
+    data_type take(std::int64_t index)
+    {
+        data_type res(std::move(slots[index & mask]));
+        full[index & mask].store(false, std::memory_order_release);
+        return res;
+    }
 
 public:
-    work_stealing_queue() = default;
+    work_stealing_queue()
+        : top(0), bottom(0), slots(new data_type[capacity])
+        , full(new std::atomic<bool>[capacity])
+    {
+        for(std::int64_t i=0; i<capacity; ++i){
+            full[i].store(false, std::memory_order_relaxed);
+        }
+    }
 
     work_stealing_queue(const work_stealing_queue&) = delete;
     work_stealing_queue& operator=(const work_stealing_queue&) = delete;
 
-    void push(data_type data)
+    // data is left alone if the ring is full
+    bool try_push(data_type& data)
     {
-        std::lock_guard<std::mutex> lock(the_mutex);
-        the_queue.push_front(std::move(data));
+        if(!has_room()){
+            return false;
+        }
+        const std::int64_t b = bottom.load(std::memory_order_relaxed);
+        slots[b & mask] = std::move(data);
+        full[b & mask].store(true, std::memory_order_release);
+        bottom.store(b+1, std::memory_order_release);
+        return true;
     }
 
+    // both are only a snapshot when other threads are active
     bool empty() const
     {
-        std::lock_guard<std::mutex> lock(the_mutex);
-        return the_queue.empty();
+        return size() == 0;
+    }
+
+    std::size_t size() const
+    {
+        const std::int64_t b = bottom.load(std::memory_order_relaxed);
+        const std::int64_t t = top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<std::size_t>(b - t) : 0;
     }
 
     bool try_pop(data_type& res)
     {
-        std::lock_guard<std::mutex> lock(the_mutex);
-        if(the_queue.empty()){
+        const std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+        if(t > b){
+            bottom.store(b+1, std::memory_order_relaxed);
             return false;
         }
-        res = std::move(the_queue.front());
-        the_queue.pop_front();
+        if(t == b){
+            // last task - race the thieves for it
+            const bool won = top.compare_exchange_strong(t, t+1,
+                                std::memory_order_seq_cst,
+                                std::memory_order_relaxed);
+            bottom.store(b+1, std::memory_order_relaxed);
+            if(!won){
+                return false;
+            }
+        }
+        res = take(b);
         return true;
     }
 
+    // a lost race reports failure rather than retrying
     bool try_steal(data_type& res)
     {
-        std::lock_guard<std::mutex> lock(the_mutex);
-        if(the_queue.empty()){
+        std::int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::int64_t b = bottom.load(std::memory_order_acquire);
+        if(t >= b){
+            return false;
+        }
+        if(!top.compare_exchange_strong(t, t+1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)){
             return false;
         }
-        res = std::move(the_queue.back());
-        the_queue.pop_back();
+        // pairs with try_push(), however stale the bottom read above was
+        full[t & mask].load(std::memory_order_acquire);
+        res = take(t);
         return true;
     }
+
+    // Steals one task into res and moves up to half of this queue in total
+    // into thief_queue, which has to be owned by the calling thread.
+    // Returns the number of tasks taken, including res.
+    // This is not one atomic batch: each task is a separate steal, with its
+    // own CAS on top, so the owner's pops and other thieves may interleave
+    // and the thief may end up with fewer than half. Claiming the whole
+    // range with a single CAS would not be safe here, as the owner pops from
+    // the bottom without one and could take the same tasks.
+    std::size_t try_steal_half(data_type& res, work_stealing_queue& thief_queue)
+    {
+        const std::size_t half = size() / 2;
+        if(!try_steal(res)){
+            return 0;
+        }
+        std::size_t taken = 1;
+        data_type task;
+        while(taken < half && thief_queue.has_room() && try_steal(task)){
+            thief_queue.try_push(task);
+            ++taken;
+        }
+        return taken;
+    }
 };
 
 
@@ -1,110 +1,1047 @@
 #ifndef WORK_STEALING_THREAD_POOL_HPP_
 #define WORK_STEALING_THREAD_POOL_HPP_
 
+#include <algorithm>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <vector>
 #include <memory>
+#include <type_traits>
 #include "function_wrapper.hpp"
+#include "priority_work_queue.hpp"
 #include "work_stealing_queue.hpp"
-#include <join_threads>
+#include "mpsc_queue.hpp"
+#include "join_threads.hpp"
+#include "idle_policy.hpp"
+#include "cpu_topology.hpp"
+#include "bulk_submit.hpp"
+#include "pool_metrics.hpp"
+#include "cancellation.hpp"
+#include "timer_wheel.hpp"
+#include "pool_future.hpp"
+#include "drain_policy.hpp"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+
+struct steal_statistics
+{
+    std::uint64_t attempts = 0;     // victim queues probed
+    std::uint64_t successes = 0;    // probes which got at least one task
+    std::uint64_t tasks_stolen = 0; // tasks taken, surplus ones included
+};
+
+// Bounds for a pool which grows and shrinks with its load. A worker is added
+// when the number of queued tasks exceeds grow_backlog per running worker,
+// at most once per grow_interval; a worker above min_threads retires once it
+// has been parked for retire_after without being woken.
+struct elastic_policy
+{
+    unsigned min_threads = 1;
+    unsigned max_threads = std::thread::hardware_concurrency();
+    std::size_t grow_backlog = 8;
+    std::chrono::microseconds grow_interval{500};
+    std::chrono::milliseconds retire_after{500};
+};
 
 
 class thread_pool
 {
     using task_type = function_wrapper;
+    using clock = std::chrono::steady_clock;
+    static constexpr clock::rep no_timer = clock::duration::max().count();
 
     std::atomic_bool done;
-    threadsafe_queue<task_type> pool_work_queue;
+    std::atomic_bool draining;
+    priority_work_queue<task_type> pool_work_queue;
+    // one slot per potential worker, so none of these ever reallocate
     std::vector<std::unique_ptr<work_stealing_queue>> queues;
+    std::vector<std::unique_ptr<mpsc_queue<task_type>>> mailboxes;
+    std::vector<worker_counters> counters;
+    std::vector<unsigned> worker_nodes;
+    std::vector<unsigned> worker_cpus;  // empty unless workers are pinned
+    unsigned node_count;
+    const idle_policy idle;
+    // each worker parks on its own, so that a task meant for one worker
+    // does not wake the lot
+    std::vector<std::unique_ptr<event_count>> wakeups;
+    std::atomic<unsigned> parked;   // waiters on all of the wakeups
+    // elastic mode, and compensation for workers blocked in managed_block()
+    const bool elastic;
+    const elastic_policy resize;
+    const unsigned parallelism;     // most workers meant to be active at once
+    std::atomic<unsigned> running;
+    std::atomic<unsigned> blocked;
+    std::unique_ptr<std::atomic<bool>[]> slot_in_use;
+    std::unique_ptr<std::atomic<bool>[]> slot_blocked;
+    std::unique_ptr<std::atomic<bool>[]> slot_idle;
+    std::atomic<std::size_t> backlog;
+    std::mutex resize_mutex;
+    std::chrono::steady_clock::time_point last_grow;
+    // delayed tasks; the atomics let workers check for due timers without
+    // taking timer_mutex
+    std::mutex timer_mutex;
+    timer_wheel<task_type> timers;
+    std::atomic<std::size_t> timer_count;
+    std::atomic<clock::rep> next_timer_due;
+    std::mutex shutdown_mutex;
+    event_count worker_exited;
     std::vector<std::thread> threads;
     join_threads joiner;
 
-    static thread_local work_stealing_queue* local_work_queue;
-    static thread_local unsigned my_index;
+    // set on the workers only; a worker may also submit to or help out
+    // another pool, so the queue is only used while my_pool is this one
+    inline static thread_local const thread_pool* my_pool = nullptr;
+    inline static thread_local work_stealing_queue* local_work_queue = nullptr;
+    inline static thread_local unsigned my_index = 0;
+    inline static thread_local std::uint32_t victim_seed = 0;
+    inline static thread_local unsigned background_picks = 0;
+
+    // xorshift32 - victims are picked at random so that thieves don't all
+    // converge on the same neighbours
+    static std::uint32_t random_victim_seed()
+    {
+        if(!victim_seed){
+            victim_seed = static_cast<std::uint32_t>(
+                std::hash<std::thread::id>()(std::this_thread::get_id())) | 1u;
+        }
+        victim_seed ^= victim_seed << 13;
+        victim_seed ^= victim_seed >> 17;
+        victim_seed ^= victim_seed << 5;
+        return victim_seed;
+    }
 
     void worker_thread(unsigned my_index_)
     {
-        my_index = my_inedx_;
+        my_pool = this;
+        my_index = my_index_;
         local_work_queue = queues[my_index].get();
+        victim_seed = 0x9e3779b9u * (my_index_+1);
+        idle_backoff backoff(idle);
+        bool idling = false;
         while(!done){
-            run_pending_task();
+            if(idling){
+                slot_idle[my_index_].store(false, std::memory_order_relaxed);
+                idling = false;
+            }
+            if(surplus_workers() && try_retire_surplus()){
+                break;
+            }
+            if(try_run_pending_task()){
+                backoff.reset();
+                continue;
+            }
+            if(draining && try_retire_drained()){
+                break;
+            }
+            idle_timer timer(counters[my_index_]);
+            slot_idle[my_index_].store(true, std::memory_order_relaxed);
+            idling = true;
+            // a parked worker sleeps no longer than until the next timer is
+            // due; scheduling an earlier one wakes it up to think again
+            const clock::rep due = next_timer_due.load();
+            auto wake_condition = [this, due]{
+                return done || (draining && !timer_count.load()) ||
+                       has_pending_work() ||
+                       next_timer_due.load() < due || surplus_workers(); };
+            if(due == no_timer && !elastic){
+                backoff.idle(*wakeups[my_index_], wake_condition);
+                continue;
+            }
+            clock::duration max_park = resize.retire_after;
+            bool parked_for_timer = !elastic;
+            if(due != no_timer){
+                const clock::duration until_due =
+                    clock::time_point(clock::duration(due)) - clock::now();
+                if(!elastic || until_due < max_park){
+                    max_park = until_due;
+                    parked_for_timer = true;
+                }
+            }
+            if(!backoff.idle_for(*wakeups[my_index_], wake_condition, max_park) &&
+               !parked_for_timer && try_retire()){
+                break;
+            }
+        }
+        slot_idle[my_index_].store(false, std::memory_order_relaxed);
+        slot_in_use[my_index_].store(false, std::memory_order_release);
+        // whatever is left in the mailbox is anybody's now; pairs with the
+        // fence in submit_to()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!mailboxes[my_index_]->empty()){
+            wake_workers(1);
+        }
+        worker_exited.notify_all();
+    }
+
+    // While the pool drains, a worker leaves as soon as there is nothing
+    // left for it, but none does before the last timer has fired.
+    bool try_retire_drained()
+    {
+        if(has_pending_work() || timer_count.load()){
+            return false;
+        }
+        running.fetch_sub(1);
+        return true;
+    }
+
+    bool any_slot_in_use() const
+    {
+        for(unsigned i=0; i<threads.size(); ++i){
+            if(slot_in_use[i].load(std::memory_order_acquire)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void wait_for_drained_workers(clock::time_point deadline)
+    {
+        while(any_slot_in_use()){
+            const unsigned key = worker_exited.prepare_wait();
+            if(!any_slot_in_use()){
+                worker_exited.cancel_wait();
+                return;
+            }
+            if(deadline == clock::time_point::max()){
+                worker_exited.commit_wait(key);
+            }
+            else if(!worker_exited.commit_wait_for(key, deadline - clock::now())){
+                return;
+            }
+        }
+    }
+
+    // Only once the workers are gone. Destroying a task breaks its promise.
+    void discard_pending_tasks()
+    {
+        task_type task;
+        while(pool_work_queue.try_pop(task)){
+            task = task_type();
+        }
+        for(unsigned i=0; i<queues.size(); ++i){
+            while(queues[i]->try_steal(task) || mailboxes[i]->try_pop(task)){
+                task = task_type();
+            }
+        }
+        std::lock_guard<std::mutex> lk(timer_mutex);
+        timers.clear();
+        publish_timers();
+    }
+
+    bool try_retire()
+    {
+        // somebody has to stay behind to fire the timers
+        const unsigned floor =
+            std::max(resize.min_threads, timer_count.load() ? 1u : 0u);
+        unsigned current = running.load(std::memory_order_relaxed);
+        while(active_of(current) > floor){
+            if(running.compare_exchange_weak(current, current-1)){
+                // we may have timed out just as a wake-up came in for us
+                if(has_pending_work()){
+                    wake_workers(1);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the two counters are read separately, so don't let a stale running
+    // count wrap round
+    unsigned active_of(unsigned running_) const
+    {
+        const unsigned blocked_ = blocked.load(std::memory_order_relaxed);
+        return running_ > blocked_ ? running_ - blocked_ : 0;
+    }
+
+    unsigned active_workers() const
+    {
+        return active_of(running.load(std::memory_order_relaxed));
+    }
+
+    // left over once a blocked worker has come back to a compensated pool
+    bool surplus_workers() const
+    {
+        return active_workers() > parallelism;
+    }
+
+    bool try_retire_surplus()
+    {
+        unsigned current = running.load(std::memory_order_relaxed);
+        while(active_of(current) > parallelism){
+            if(running.compare_exchange_weak(current, current-1)){
+                if(has_pending_work()){
+                    wake_workers(1);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // must be called with resize_mutex held
+    bool start_worker_in_free_slot()
+    {
+        for(unsigned i=0; i<threads.size(); ++i){
+            if(!slot_in_use[i].load(std::memory_order_acquire)){
+                try{
+                    start_worker(i);
+                }
+                catch(...){
+                    return false;
+                }
+                last_grow = std::chrono::steady_clock::now();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // must be called with resize_mutex held, or before any worker runs
+    bool start_worker(unsigned index)
+    {
+        if(threads[index].joinable()){
+            threads[index].join();  // retired, but possibly not quite gone
+        }
+        slot_in_use[index].store(true, std::memory_order_relaxed);
+        running.fetch_add(1, std::memory_order_relaxed);
+        try{
+            threads[index] = std::thread(&thread_pool::worker_thread,this,index);
+        }
+        catch(...){
+            running.fetch_sub(1, std::memory_order_relaxed);
+            slot_in_use[index].store(false, std::memory_order_relaxed);
+            throw;
+        }
+        if(!worker_cpus.empty()){
+            cpu_topology::pin(threads[index], worker_cpus[index]);
+        }
+        return true;
+    }
+
+    // Growing is best effort: it is skipped if another thread is already at
+    // it, and a failure to start a thread is not reported to the submitter.
+    void note_queued(std::size_t count)
+    {
+        if(!elastic){
+            return;
+        }
+        const std::size_t depth =
+            backlog.fetch_add(count, std::memory_order_relaxed) + count;
+        const unsigned workers = active_workers();
+        if(workers >= resize.max_threads ||
+           (workers != 0 && depth <= resize.grow_backlog * workers)){
+            return;
+        }
+        std::unique_lock<std::mutex> lk(resize_mutex, std::try_to_lock);
+        if(!lk.owns_lock() || done){
+            return;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if(active_workers() >= resize.max_threads ||
+           (active_workers() != 0 && now - last_grow < resize.grow_interval)){
+            return;
+        }
+        start_worker_in_free_slot();
+    }
+
+    // Keeps a worker running for each one blocked in managed_block(), up to
+    // parallelism (or min_threads for an elastic pool, which otherwise grows
+    // with its backlog as usual).
+    void compensate_for_blocked_worker()
+    {
+        const unsigned wanted = elastic ?
+            std::max(resize.min_threads, 1u) : parallelism;
+        if(active_workers() >= wanted){
+            return;
+        }
+        std::lock_guard<std::mutex> lk(resize_mutex);
+        if(!done && active_workers() < wanted){
+            start_worker_in_free_slot();
+        }
+    }
+
+    // Wakes up to count parked workers, whichever they are.
+    void wake_workers(std::size_t count)
+    {
+        // pairs with the fence in event_count::prepare_wait(): either a
+        // worker about to park is seen here, or it sees the new work; with
+        // nobody parked that is all a submitter pays for
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!parked.load(std::memory_order_relaxed)){
+            return;
+        }
+        const unsigned slot_count = static_cast<unsigned>(wakeups.size());
+        const unsigned first = random_victim_seed() % slot_count;
+        for(unsigned i=0; i<slot_count && count; ++i){
+            event_count& wakeup = *wakeups[(first+i) % slot_count];
+            if(wakeup.has_waiters()){
+                wakeup.notify_one();
+                --count;
+            }
+        }
+    }
+
+    void wake_all_workers()
+    {
+        for(unsigned i=0; i<wakeups.size(); ++i){
+            wakeups[i]->notify_all();
+        }
+    }
+
+    // must be called with timer_mutex held
+    void publish_timers()
+    {
+        timer_count.store(timers.size());
+        next_timer_due.store(timers.empty() ? no_timer :
+                             timers.next_event().time_since_epoch().count());
+    }
+
+    void schedule_task(clock::time_point when, task_type task)
+    {
+        if(done){
+            return;
+        }
+        bool scheduled;
+        bool earlier = false;
+        {
+            std::lock_guard<std::mutex> lk(timer_mutex);
+            const clock::rep previous = next_timer_due.load();
+            scheduled = timers.schedule(when, task);
+            if(scheduled){
+                publish_timers();
+                earlier = next_timer_due.load() < previous;
+            }
+        }
+        if(!scheduled){
+            push_task(std::move(task), task_priority::normal);
+            return;
+        }
+        note_queued(0);     // an elastic pool may have no workers left
+        if(earlier){
+            wake_workers(1);
+        }
+    }
+
+    // Any thread may fire the due timers, whoever gets the lock does it.
+    void run_due_timers()
+    {
+        if(!timer_count.load(std::memory_order_relaxed)){
+            return;
+        }
+        const clock::time_point now = clock::now();
+        if(now.time_since_epoch().count() <
+           next_timer_due.load(std::memory_order_relaxed)){
+            return;
+        }
+        std::vector<task_type> due;
+        {
+            std::unique_lock<std::mutex> lk(timer_mutex, std::try_to_lock);
+            if(!lk.owns_lock()){
+                return;
+            }
+            timers.advance(now, [&due](task_type task){
+                due.push_back(std::move(task)); });
+            publish_timers();
+        }
+        if(!due.empty()){
+            enqueue_batch(due);
+        }
+    }
+
+    void note_dequeued()
+    {
+        if(elastic){
+            backlog.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // how a pool_future of this pool waits for its task
+    static bool help_out(void* pool)
+    {
+        return static_cast<thread_pool*>(pool)->try_run_pending_task();
+    }
+
+    static bool may_sleep(void* pool)
+    {
+        return my_pool != pool;
+    }
+
+    inline static const pool_future_waiter future_waiter{&help_out, &may_sleep};
+
+    template<typename FunctionType>
+    auto make_future_task(FunctionType f)
+    {
+        return make_pool_future_task(std::move(f), this, &future_waiter);
+    }
+
+    // both null unless called on one of this pool's workers
+    work_stealing_queue* own_queue() const
+    {
+        return my_pool == this ? local_work_queue : nullptr;
+    }
+
+    worker_counters* my_counters()
+    {
+        return my_pool == this ? &counters[my_index] : nullptr;
+    }
+
+    // Tasks sent to a worker's mailbox are left to it for as long as it
+    // takes to get round to them. Another worker only takes one over if the
+    // owner is blocked in managed_block() or busy with a backlog of mailbox
+    // tasks; a thread outside the pool - one waiting on a pool_future, say -
+    // never does. Whoever comes along takes the tasks of an owner which has
+    // retired, as nobody else would.
+    bool can_take_from_mailbox(unsigned index)
+    {
+        const mpsc_queue<task_type>& mailbox = *mailboxes[index];
+        if(mailbox.empty()){
+            return false;
         }
+        if(!slot_in_use[index].load(std::memory_order_relaxed)){
+            return true;
+        }
+        if(!own_queue()){
+            return false;
+        }
+        return index == my_index || can_take_from_mailbox_of_other(index);
+    }
+
+    bool can_take_from_mailbox_of_other(unsigned index) const
+    {
+        return !slot_in_use[index].load(std::memory_order_relaxed) ||
+               slot_blocked[index].load(std::memory_order_relaxed) ||
+               (mailboxes[index]->size() > 1 &&
+                !slot_idle[index].load(std::memory_order_relaxed));
+    }
+
+    bool has_pending_work()
+    {
+        if(!pool_work_queue.empty()){
+            return true;
+        }
+        for(unsigned i=0; i<queues.size(); ++i){
+            if(!queues[i]->empty() || can_take_from_mailbox(i)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool pop_task_from_mailbox(task_type& task)
+    {
+        return own_queue() && mailboxes[my_index]->try_pop(task);
     }
 
     bool pop_task_from_local_queue(task_type& task)
     {
-        return local_work_queue && local_work_queue->try_pop(task);
+        work_stealing_queue* const local = own_queue();
+        return local && local->try_pop(task);
     }
 
-    bool pop_task_from_pool_queue(task_type& task)
+    bool pop_task_from_pool_queue(task_type& task, task_priority priority)
     {
-        return pool_work_queue.try_pop(task);
+        return pool_work_queue.try_pop(task, priority);
     }
 
+    // pinned workers try the queues on their own NUMA node first
     bool pop_task_from_other_thread_queue(task_type& task)
     {
-        for(unsigned i=0; i<queues.size(); ++i){
-            const unsigned index = (my_index+i+1) % queues.size();
-            if(queues[index]->try_steal(task)){
+        if(own_queue() && node_count > 1){
+            const unsigned my_node = worker_nodes[my_index];
+            return steal_from_any(task, [this, my_node](unsigned index){
+                        return worker_nodes[index] == my_node; }) ||
+                   steal_from_any(task, [this, my_node](unsigned index){
+                        return worker_nodes[index] != my_node; });
+        }
+        return steal_from_any(task, [](unsigned){ return true; });
+    }
+
+    template<typename Predicate>
+    bool steal_from_any(task_type& task, Predicate is_candidate)
+    {
+        const unsigned queue_count = static_cast<unsigned>(queues.size());
+        if(!queue_count){
+            return false;
+        }
+        const bool is_worker = own_queue() != nullptr;
+        const unsigned first_victim = random_victim_seed() % queue_count;
+        for(unsigned i=0; i<queue_count; ++i){
+            const unsigned index = (first_victim+i) % queue_count;
+            if((is_worker && index == my_index) || !is_candidate(index)){
+                continue;
+            }
+            if(steal_from(*queues[index], task) ||
+               (can_take_from_mailbox(index) && mailboxes[index]->try_pop(task))){
                 return true;
             }
         }
         return false;
     }
 
-public:
-    thread_pool()
-        : done(false), joiner(threads)
+    // workers take up to half of the victim's queue, one steal at a time,
+    // the surplus going to their own queue; other threads only take the one
+    // task they will run
+    bool steal_from(work_stealing_queue& victim, task_type& task)
     {
-        const unsigned thread_count = std::thread::hardware_concurrency();
+        work_stealing_queue* const local = own_queue();
+        if(!local){
+            return victim.try_steal(task);
+        }
+        const std::uint64_t taken = victim.try_steal_half(task, *local);
+        if(worker_counters* const mine = my_counters()){
+            mine->steal_attempted(taken);
+        }
+        return taken != 0;
+    }
+
+    // only normal priority tasks go to the local queue, the others have to
+    // be seen by every worker; so does anything that overflows the queue
+    void push_task(task_type task, task_priority priority)
+    {
+        // once the pool has shut down the task is dropped right away
+        if(done){
+            return;
+        }
+        // counted before it is published, as whoever runs it uncounts it
+        note_queued(1);
+        work_stealing_queue* const local = own_queue();
+        if(!local || priority != task_priority::normal ||
+           !local->try_push(task)){
+            pool_work_queue.push(std::move(task), priority);
+        }
+        // local tasks can be stolen, so wake a parked worker for those too
+        wake_workers(1);
+    }
+
+    void enqueue_batch(std::vector<task_type>& tasks)
+    {
+        if(done){
+            return;
+        }
+        note_queued(tasks.size());
+        if(work_stealing_queue* const local = own_queue()){
+            for(auto& task : tasks){
+                if(!local->try_push(task)){
+                    pool_work_queue.push(std::move(task));
+                }
+            }
+        }
+        else{
+            pool_work_queue.push_range(tasks.begin(), tasks.end());
+        }
+        wake_workers(tasks.size());
+    }
+
+    // Each worker slot gets a spare one, taken by a compensating worker
+    // while the first is blocked in managed_block().
+    static unsigned slots_for(unsigned max_threads)
+    {
+        return 2*max_threads;
+    }
+
+    thread_pool(unsigned initial_threads, unsigned max_threads,
+                bool elastic_, const elastic_policy& resize_,
+                const idle_policy& idle_, const placement_policy& placement)
+        : done(false), draining(false), counters(slots_for(max_threads))
+        , worker_nodes(slots_for(max_threads), 0)
+        , node_count(1), idle(idle_)
+        , parked(0)
+        , elastic(elastic_), resize(resize_)
+        , parallelism(max_threads), running(0), blocked(0)
+        , slot_in_use(new std::atomic<bool>[slots_for(max_threads)])
+        , slot_blocked(new std::atomic<bool>[slots_for(max_threads)])
+        , slot_idle(new std::atomic<bool>[slots_for(max_threads)])
+        , backlog(0), timer_count(0), next_timer_due(no_timer)
+        , threads(slots_for(max_threads)), joiner(threads)
+    {
+        const unsigned slot_count = slots_for(max_threads);
+        if(placement.pin_workers){
+            const cpu_topology topology;
+            for(unsigned i=0; i<slot_count; ++i){
+                worker_cpus.push_back(topology.cpu_for_worker(i));
+                worker_nodes[i] = topology.node_for_worker(i);
+            }
+            if(placement.numa_aware_stealing){
+                node_count = topology.node_count();
+            }
+        }
+        // all the queues have to exist before the first worker starts stealing
+        for(unsigned i=0; i<slot_count; ++i){
+            queues.push_back(std::unique_ptr<work_stealing_queue>(
+                new work_stealing_queue));
+            mailboxes.push_back(std::unique_ptr<mpsc_queue<task_type>>(
+                new mpsc_queue<task_type>));
+            wakeups.push_back(std::unique_ptr<event_count>(
+                new event_count(&parked)));
+            slot_in_use[i].store(false, std::memory_order_relaxed);
+            slot_blocked[i].store(false, std::memory_order_relaxed);
+            slot_idle[i].store(false, std::memory_order_relaxed);
+        }
         try{
-            for(unsigned i=0; i<thread_count; ++i){
-                queues.push_back(std::unique_ptr<work_stealing_queue>(
-                    new work_stealing_queue));
-                threads.push_back(&thread_pool::worker_thread,this,i));
+            for(unsigned i=0; i<initial_threads; ++i){
+                start_worker(i);
             }
         }
         catch(...){
             done = true;
+            wake_all_workers();
             throw;
         }
     }
 
+public:
+    explicit thread_pool(
+        unsigned thread_count = std::thread::hardware_concurrency(),
+        const idle_policy& idle_ = idle_policy(),
+        const placement_policy& placement = placement_policy())
+        : thread_pool(thread_count, thread_count, false, elastic_policy(),
+                      idle_, placement)
+        { }
+
+    // starts min_threads workers and grows to at most max_threads
+    explicit thread_pool(
+        const elastic_policy& resize_,
+        const idle_policy& idle_ = idle_policy(),
+        const placement_policy& placement = placement_policy())
+        : thread_pool(resize_.min_threads,
+                      std::max(resize_.min_threads, resize_.max_threads),
+                      true, resize_, idle_, placement)
+        { }
+
+    // Whatever the pool has not started yet is discarded, unless it has
+    // already been shut down with another policy.
     ~thread_pool()
     {
+        shutdown(drain_policy{drain_mode::discard});
+    }
+
+    // Stops the pool and joins its workers. Unless the policy discards them,
+    // the workers first run the queued tasks, and leave one by one once
+    // there are none left. Parked workers are woken right away, so shutdown
+    // takes no longer than the tasks themselves - and a drain deadline does
+    // not interrupt a task which is already running. Tasks submitted after
+    // shutdown() has returned are dropped at once. Later calls return right
+    // away; it must not be called from one of the pool's own tasks.
+    void shutdown(const drain_policy& policy = drain_policy())
+    {
+        std::lock_guard<std::mutex> lk(shutdown_mutex);
+        if(done){
+            return;
+        }
+        const clock::time_point deadline = policy.stop_at();
+        if(clock::now() < deadline){
+            draining = true;
+            wake_all_workers();
+            wait_for_drained_workers(deadline);
+            // a task sent to a worker's mailbox just as it left
+            while(clock::now() < deadline && try_run_pending_task())
+                { }
+        }
         done = true;
+        // make sure no submitter is half way through adding a worker
+        { std::lock_guard<std::mutex> lk(resize_mutex); }
+        wake_all_workers();
+        for(auto& t : threads){
+            if(t.joinable()){
+                t.join();
+            }
+        }
+        running.store(0);
+        discard_pending_tasks();
+    }
+
+    // Critical tasks are picked before anything else, background ones after
+    // everything else apart from the occasional one let through so that the
+    // lane does not starve. Waiting on the returned pool_future runs pending
+    // tasks of this pool meanwhile.
+    template<typename FunctionType>
+    pool_future<std::invoke_result_t<FunctionType>>
+    submit( FunctionType f, task_priority priority = task_priority::normal )
+    {
+        auto [task, res] = make_future_task(std::move(f));
+        push_task(std::move(task), priority);
+        return std::move(res);
     }
 
+    // As submit(), for callers which need a std::future - to hand it to an
+    // API taking one, or to wait on it without helping the pool.
     template<typename FunctionType>
-    std::future<std::result_of_t<FunctionType()>>
-    submit( FunctionType f )
+    std::future<std::invoke_result_t<FunctionType>>
+    submit_std( FunctionType f, task_priority priority = task_priority::normal )
     {
-        using result_type = std::result_of_t<FunctionType()>;
-        std::packaged_task<result_type()> task(f);
+        using result_type = std::invoke_result_t<FunctionType>;
+        std::packaged_task<result_type()> task(std::move(f));
         std::future<result_type> res(task.get_future());
-        if(local_work_queue){
-            local_work_queue->push(std::move(task));
+        push_task(std::move(task), priority);
+        return res;
+    }
+
+    // As above, but if token is cancelled before the task is picked up it
+    // is skipped, and the future holds task_cancelled.
+    template<typename FunctionType>
+    pool_future<std::invoke_result_t<FunctionType>>
+    submit( const cancellation_token& token, FunctionType f,
+            task_priority priority = task_priority::normal )
+    {
+        return submit(make_cancellable(token, std::move(f)), priority);
+    }
+
+    // Runs f on the pool once when has come, or soon after. No thread sleeps
+    // for it: the workers fire due timers between tasks and park no longer
+    // than until the next one is due. Timers still pending when the pool is
+    // destroyed, or shut down without draining, are dropped, their futures
+    // holding broken_promise.
+    template<typename FunctionType>
+    pool_future<std::invoke_result_t<FunctionType>>
+    submit_at( std::chrono::steady_clock::time_point when, FunctionType f )
+    {
+        auto [task, res] = make_future_task(std::move(f));
+        schedule_task(when, std::move(task));
+        return std::move(res);
+    }
+
+    template<typename Rep, typename Period, typename FunctionType>
+    pool_future<std::invoke_result_t<FunctionType>>
+    submit_after( const std::chrono::duration<Rep,Period>& delay, FunctionType f )
+    {
+        return submit_at(clock::now() + delay, std::move(f));
+    }
+
+#if defined(__cpp_impl_coroutine)
+    // co_await pool.schedule() suspends the coroutine and resumes it on one
+    // of the workers. Awaited on a worker, the resumption goes to that
+    // worker's own queue, so the coroutine stays on the same core unless
+    // another worker steals it.
+    class schedule_awaiter
+    {
+        thread_pool& pool;
+        task_priority priority;
+
+    public:
+        schedule_awaiter(thread_pool& pool_, task_priority priority_) noexcept
+            : pool(pool_), priority(priority_)
+            { }
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> awaiting)
+        {
+            pool.post([awaiting]{ awaiting.resume(); }, priority);
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    schedule_awaiter schedule(task_priority priority = task_priority::normal) noexcept
+    {
+        return schedule_awaiter(*this, priority);
+    }
+#endif
+
+    // Sends the task to the mailbox of worker worker_index (modulo the
+    // pool's size), which runs it before looking at its own queue or
+    // stealing; use it to keep work on the same data on the same core.
+    // Another worker only takes it over if the target is busy with a
+    // backlog of such tasks, is blocked in managed_block(), or has retired.
+    // A task waiting for one it sent to its own worker has to do so inside
+    // managed_block(), or it waits forever.
+    template<typename FunctionType>
+    pool_future<std::invoke_result_t<FunctionType>>
+    submit_to( unsigned worker_index, FunctionType f )
+    {
+        auto [task, res] = make_future_task(std::move(f));
+        if(!parallelism || done){
+            push_task(std::move(task), task_priority::normal);
+            return std::move(res);
+        }
+        note_queued(1);
+        const unsigned index = worker_index % parallelism;
+        mailboxes[index]->push(std::move(task));
+        // pairs with the fences in worker_thread() and blocking_region, so
+        // that an owner which has just left or blocked is noticed
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // wake just the owner, unless the task is open to the others
+        if(can_take_from_mailbox_of_other(index)){
+            wake_workers(1);
         }
         else{
-            pool_work_queue.push(std::move(task));
+            wakeups[index]->notify_one();
+        }
+        return std::move(res);
+    }
+
+    // Fire-and-forget submission: there is no future, and so no shared
+    // state to allocate. f must not throw.
+    template<typename FunctionType>
+    void post( FunctionType f, task_priority priority = task_priority::normal )
+    {
+        push_task(task_type(std::move(f)), priority);
+    }
+
+    // f is silently dropped if token is cancelled before it is picked up
+    template<typename FunctionType>
+    void post( const cancellation_token& token, FunctionType f,
+               task_priority priority = task_priority::normal )
+    {
+        post([token, f=std::move(f)]() mutable {
+                if(!token.is_cancelled())
+                    f();
+             }, priority);
+    }
+
+    // Moves the callables out of [first,last) and enqueues them all with a
+    // single synchronization and wake-up.
+    template<typename InputIt>
+    std::vector<pool_future<bulk_result_t<InputIt>>>
+    submit_bulk(InputIt first, InputIt last)
+    {
+        std::vector<task_type> tasks;
+        std::vector<pool_future<bulk_result_t<InputIt>>> res;
+        for(; first != last; ++first){
+            auto [task, future] = make_future_task(std::move(*first));
+            res.push_back(std::move(future));
+            tasks.push_back(std::move(task));
         }
+        enqueue_batch(tasks);
         return res;
     }
 
-    void run_pending_task()
+    // Runs f(0) ... f(n-1) on the pool; the returned future becomes ready
+    // when all of them have finished and rethrows the first exception.
+    template<typename FunctionType>
+    std::future<void> submit_n(std::size_t n, FunctionType f)
+    {
+        std::vector<task_type> tasks;
+        tasks.reserve(n);
+        std::future<void> res( make_batch_tasks(n, std::move(f),
+            [&tasks](task_type task){ tasks.push_back(std::move(task)); }) );
+        enqueue_batch(tasks);
+        return res;
+    }
+
+    bool try_run_pending_task()
     {
+        run_due_timers();
         task_type task;
-        if(pop_task_from_local_queue(task) ||
-           pop_task_from_pool_queue(task)  ||
-           pop_task_from_other_thread_queue(task))
+        if(pool_work_queue.try_pop_starved(task, background_picks) ||
+           pop_task_from_pool_queue(task, task_priority::critical) ||
+           pop_task_from_mailbox(task) ||
+           pop_task_from_local_queue(task) ||
+           pop_task_from_pool_queue(task, task_priority::normal) ||
+           pop_task_from_other_thread_queue(task) ||
+           pop_task_from_pool_queue(task, task_priority::background))
         {
+            note_dequeued();
             task();
+            if(worker_counters* const mine = my_counters()){
+                mine->task_executed();
+            }
+            return true;
         }
-        else{
+        return false;
+    }
+
+    void run_pending_task()
+    {
+        if(!try_run_pending_task()){
             std::this_thread::yield();
         }
     }
+
+    // Marks the calling worker as blocked for the lifetime of the object, so
+    // that the pool can start a compensating worker to keep its parallelism
+    // up; the surplus worker retires once this one is back. Outside the
+    // pool's own workers it does nothing.
+    // Its mailbox is open to the other workers meanwhile, as it may well be
+    // waiting on a task sent there.
+    class blocking_region
+    {
+        thread_pool* pool;
+
+    public:
+        // a region nested in another one leaves the accounting to that
+        explicit blocking_region(thread_pool& pool_)
+            : pool(my_pool == &pool_ &&
+                   !pool_.slot_blocked[my_index].exchange(true) ?
+                   &pool_ : nullptr)
+        {
+            if(pool){
+                pool->blocked.fetch_add(1);
+                pool->compensate_for_blocked_worker();
+                // pairs with the fence in submit_to()
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(!pool->mailboxes[my_index]->empty()){
+                    pool->wake_workers(1);
+                }
+            }
+        }
+
+        blocking_region(const blocking_region&) = delete;
+        blocking_region& operator=(const blocking_region&) = delete;
+
+        ~blocking_region()
+        {
+            if(pool){
+                pool->slot_blocked[my_index].store(false);
+                pool->blocked.fetch_sub(1);
+                // a parked worker may be the one to retire
+                if(pool->surplus_workers()){
+                    pool->wake_workers(1);
+                }
+            }
+        }
+    };
+
+    // Runs f, which is expected to block (on I/O, a lock, a future ...),
+    // inside a blocking_region.
+    template<typename FunctionType>
+    std::invoke_result_t<FunctionType> managed_block( FunctionType f )
+    {
+        blocking_region region(*this);
+        return f();
+    }
+
+    // workers currently running, including blocked ones; fixed unless the
+    // pool is elastic or compensating for a blocked worker
+    unsigned worker_count() const
+    {
+        return running.load(std::memory_order_relaxed);
+    }
+
+    // One entry per worker slot, including the spare ones used while a
+    // worker is blocked.
+    // Tasks run by threads outside the pool are not counted.
+    pool_metrics metrics() const
+    {
+        pool_metrics res;
+        res.pool_queue_depth = pool_work_queue.size();
+        for(std::size_t i=0; i<counters.size(); ++i){
+            res.workers.push_back(counters[i].read());
+            res.workers.back().queue_depth =
+                queues[i]->size() + mailboxes[i]->size();
+        }
+        return res;
+    }
+
+    steal_statistics steal_stats() const
+    {
+        const worker_metrics total = metrics().total();
+        steal_statistics res;
+        res.attempts = total.steal_attempts;
+        res.successes = total.steal_successes;
+        res.tasks_stolen = total.tasks_stolen;
+        return res;
+    }
 };
 
 #endif /* WORK_STEALING_THREAD_POOL_HPP_ */